@@ -0,0 +1,5 @@
+# extra script for [env:fuzz]: build with clang and link against libFuzzer.
+Import("env")
+
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(LINKFLAGS=["-fsanitize=fuzzer,address"])
@@ -0,0 +1,6 @@
+#!/bin/sh
+# usage: run-bench.sh [-r repetitions] [--save path] [--compare path] [name...]
+set -eu
+
+pio run -e bench
+.pio/build/bench/program "$@"
@@ -11,32 +11,24 @@ export PLATFORMIO_BUILD_FLAGS='
     -USUNK_ENABLE
     -USUNM_ENABLE
     -UWIPE_SETTINGS
-    -UDEBUG_TIMINGS
     -UUHID_LED_ENABLE
     -UUHID_LED_TEST
     -UWAIT_PIN
     -UWAIT_SERIAL
-    -UBUZZER_VERBOSE
-    -USUNK_VERBOSE
-    -USUNM_VERBOSE
-    -UUHID_VERBOSE
+    -UDEBUG_BINARY
 ';
 build "$@"
 
-# build with feature flags on, but verbose flags off.
+# build with feature flags on, but binary logging off.
 export PLATFORMIO_BUILD_FLAGS='
     -DSUNK_ENABLE
     -DSUNM_ENABLE
     -DWIPE_SETTINGS
-    -DDEBUG_TIMINGS
     -DUHID_LED_ENABLE
     -DUHID_LED_TEST
     -DWAIT_PIN
     -DWAIT_SERIAL
-    -UBUZZER_VERBOSE
-    -USUNK_VERBOSE
-    -USUNM_VERBOSE
-    -UUHID_VERBOSE
+    -UDEBUG_BINARY
 '; build "$@"
 
 # build with all flags on.
@@ -44,13 +36,9 @@ export PLATFORMIO_BUILD_FLAGS='
     -DSUNK_ENABLE
     -DSUNM_ENABLE
     -DWIPE_SETTINGS
-    -DDEBUG_TIMINGS
     -DUHID_LED_ENABLE
     -DUHID_LED_TEST
     -DWAIT_PIN
     -DWAIT_SERIAL
-    -DBUZZER_VERBOSE
-    -DSUNK_VERBOSE
-    -DSUNM_VERBOSE
-    -DUHID_VERBOSE
+    -DDEBUG_BINARY
 '; build "$@"
@@ -0,0 +1,29 @@
+#!/bin/sh
+# usage: run-fuzz.sh [corpus dir] [libFuzzer options...]
+set -eu
+
+corpus=${1-.pio/fuzz-corpus}
+[ $# -gt 0 ] && shift
+
+pio run -e fuzz
+
+# seed the corpus with inputs from the test suite, if it’s new.
+if ! [ -e "$corpus" ]; then
+    mkdir -p "$corpus"
+    seed() { printf "$2" > "$corpus/$1"; }
+    seed hid-keyboard-a '\000\001\000\000\004\000\000\000\000\000'
+    seed hid-keyboard-release '\000\001\000\000\000\000\000\000\000\000'
+    seed hid-keyboard-ctrl-r-space '\000\001\020\000\054\000\000\000\000\000'
+    seed hid-keyboard-short '\000\001\000\000\004'
+    seed hid-mouse '\000\002\001\005\373'
+    seed sunk-reset-bell '\001\001\002'
+    seed sunk-click '\001\012\013'
+    seed sunk-led-layout '\001\016\017\017'
+    seed cli-type '\002\000t\000y\000p\000e\000 \000h\000i\000\r'
+    seed cli-alt-mouse '\002\000\033\000w\000\033\000\061'
+    seed cli-esc-timeout '\002\000\033\200w\000\r'
+    seed cli-stop-a '\002\000s\000t\000o\000p\000 \000a\000\r'
+fi
+
+# -close_fd_mask=1 hides our (very chatty) debug logging on stdout.
+exec .pio/build/fuzz/program -close_fd_mask=1 "$@" "$corpus"
@@ -1,9 +1,17 @@
 #!/bin/sh
 set -eu
 
+# usage: run-tests.sh [all [-j jobs] [--json path] | test_name [--history path]]
+[ $# -gt 0 ] || set -- all
+
 for ke in -DSUNK_ENABLE ''; do
 for me in -DSUNM_ENABLE ''; do
     PLATFORMIO_BUILD_FLAGS="$ke $me" pio run -e linux
-    .pio/build/linux/program ${1-all}
+    .pio/build/linux/program "$@"
 done
 done
+
+# binary debug logging, so the tests that encode and decode it (like
+# debug_binary) actually run, and everything else still passes with it.
+PLATFORMIO_BUILD_FLAGS='-DSUNK_ENABLE -DSUNM_ENABLE -DDEBUG_BINARY' pio run -e linux
+.pio/build/linux/program "$@"
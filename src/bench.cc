@@ -0,0 +1,185 @@
+#include "config.h"
+
+#if defined(USB3SUN_HAL_LINUX_NATIVE) && defined(USB3SUN_BENCH)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bindings.h"
+#include "hal.h"
+#include "macro.h"
+#include "pinout.h"
+#include "settings.h"
+#include "sunk.h"
+#include "sunm.h"
+#include "view.h"
+
+// defined in main.cc.
+void setup();
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len);
+
+namespace {
+
+struct Benchmark {
+  const char *name;
+  void (*run)(size_t iterations);
+};
+
+// each iteration is one make or one break, so pairs of iterations leave
+// the adapter in the state they found it.
+const Benchmark BENCHMARKS[] = {
+  {"uhid_keyboard_report", [](size_t iterations) {
+    // usb report → diff against last report → View::sendKeys → sunkSend.
+    static const uint8_t reports[2][8]{{0, 0, USBK_A}, {}};
+    usb3sun_mock_uhid_interface_protocol(USB3SUN_UHID_KEYBOARD);
+    for (size_t i = 0; i < iterations; i++)
+      tuh_hid_report_received_cb(1, 0, reports[i % 2], sizeof reports[i % 2]);
+  }},
+  {"view_send_keys", [](size_t iterations) {
+    // View::sendKeys → DefaultView → UsbkToSunk → sunkSend.
+    static const UsbkChanges changes[2]{
+      {UsbkReport{0, {}, {USBK_A}}, {}, {{USBK_A, true}}, 0, 1},
+      {UsbkReport{}, {}, {{USBK_A, false}}, 0, 1},
+    };
+    for (size_t i = 0; i < iterations; i++)
+      View::sendKeys(changes[i % 2]);
+  }},
+  {"sunk_send_macro", [](size_t iterations) {
+    // format and queue the macro, then type it all out.
+    for (size_t i = 0; i < iterations; i++) {
+      sunkSend("%x %x mkp\n", 0x12, 3);
+      while (macro.busy())
+        macro.update();
+    }
+  }},
+  {"sunm_send", [](size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+      sunmSend(i % 2 ? 1 : -1, i % 2 ? -1 : 1, i % 2, false, false);
+  }},
+  {"display_text", [](size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+      usb3sun_display_text(0, 0, i % 2, "usb3sun 0123456789");
+  }},
+  {"settings_write", [](size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+      settings.write<ClickDurationV2>(i % 2 ? 5 : 10);
+  }},
+};
+
+using Clock = std::chrono::steady_clock;
+
+double run_ns(const Benchmark &benchmark, size_t iterations) {
+  auto start = Clock::now();
+  benchmark.run(iterations);
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+struct Result {
+  double median;
+  double min;
+};
+
+Result measure(const Benchmark &benchmark, size_t repetitions) {
+  // warm up, while finding an even number of iterations that takes ≥ 10 ms.
+  size_t iterations = 2;
+  while (run_ns(benchmark, iterations) < 10e6 && iterations < size_t{1} << 30)
+    iterations *= 2;
+  std::vector<double> samples{};
+  for (size_t i = 0; i < repetitions; i++)
+    samples.push_back(run_ns(benchmark, iterations) / iterations);
+  std::sort(samples.begin(), samples.end());
+  return Result {samples[samples.size() / 2], samples[0]};
+}
+
+void help() {
+  fprintf(stderr, "usage: path/to/program [-r repetitions] [--save path] [--compare path] [name...]\n");
+  fprintf(stderr, "...where name can be one of:\n");
+  for (const auto &benchmark : BENCHMARKS)
+    fprintf(stderr, "    %s\n", benchmark.name);
+}
+
+}
+
+int main(int argc, char **argv) {
+  size_t repetitions = 9;
+  const char *savePath = nullptr;
+  const char *comparePath = nullptr;
+  std::vector<const char *> names{};
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      repetitions = std::max(atol(argv[++i]), 1l);
+    } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+      savePath = argv[++i];
+    } else if (!strcmp(argv[i], "--compare") && i + 1 < argc) {
+      comparePath = argv[++i];
+    } else if (argv[i][0] == '-') {
+      help();
+      return 1;
+    } else {
+      names.push_back(argv[i]);
+    }
+  }
+
+  std::map<std::string, double> baseline{};
+  if (comparePath) {
+    std::ifstream file{comparePath};
+    if (!file) {
+      perror("fatal: failed to open baseline");
+      return 1;
+    }
+    std::string name;
+    double ns;
+    while (file >> name >> ns)
+      baseline[name] = ns;
+  }
+
+  // keep the debug logging out of our results (and our terminal).
+  int devNull = open("/dev/null", O_WRONLY);
+  if (devNull == -1 || dup2(devNull, STDOUT_FILENO) == -1) {
+    perror("fatal: failed to redirect stdout");
+    return 1;
+  }
+  usb3sun_test_init(0);
+  usb3sun_test_virtual_clock(true);
+  setup();
+
+  std::vector<std::pair<const char *, double>> results{};
+  fprintf(stderr, "%-24s %12s %12s %12s %8s\n", "benchmark", "ns/op", "min", "baseline", "change");
+  for (const auto &benchmark : BENCHMARKS) {
+    if (!names.empty() && std::none_of(names.begin(), names.end(),
+        [&](const char *name) { return !strcmp(name, benchmark.name); }))
+      continue;
+    Result result = measure(benchmark, repetitions);
+    pinout.debugFlush();
+    results.emplace_back(benchmark.name, result.median);
+    fprintf(stderr, "%-24s %12.1f %12.1f", benchmark.name, result.median, result.min);
+    auto old = baseline.find(benchmark.name);
+    if (old != baseline.end())
+      fprintf(stderr, " %12.1f %+7.1f%%", old->second, (result.median / old->second - 1) * 100);
+    fprintf(stderr, "\n");
+  }
+
+  if (savePath) {
+    std::ofstream file{savePath};
+    for (const auto &[name, ns] : results)
+      file << name << " " << ns << "\n";
+    if (!file) {
+      perror("fatal: failed to save baseline");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#endif
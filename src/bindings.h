@@ -1,6 +1,7 @@
 #ifndef USB3SUN_BINDINGS_H
 #define USB3SUN_BINDINGS_H
 
+#include <cstddef>
 #include <cstdint>
 
 #define USBK_RESERVED 0
@@ -110,16 +111,6 @@
 // Sun keyboard to USB converter https://kentie.net/article/sunkbd/index.htm
 // PC-Sun keyboard mapping in Rose multi-platform KVM switches http://www.rose-electronics.de/additional/sun_keyboard_mapping.pdf
 
-struct UsbkToSunk {
-  uint8_t dv[256]{};
-  uint8_t sel[256]{};
-  uint8_t special[256]{};
-
-  UsbkToSunk();
-};
-
-extern UsbkToSunk USBK_TO_SUNK;
-
 struct DvBinding {
   uint8_t usbkModifier;
   uint8_t sunkMake;
@@ -139,7 +130,7 @@ struct DvSelBinding {
   uint8_t sunkBreak;
 };
 
-static const DvBinding DV_BINDINGS[] = {
+inline constexpr DvBinding DV_BINDINGS[] = {
   // direct equivalents
   {1u << 1, 0x63, 0xE3}, // 81. left “Shift”
   {1u << 5, 0x6E, 0xEE}, // 92. right “Shift”
@@ -159,7 +150,7 @@ static const DvBinding DV_BINDINGS[] = {
   // {1u << 4, none, none}, // CtrlR → usb3sun settings and DV_SEL_BINDINGS
 };
 
-const SelBinding SEL_BINDINGS[] = {
+inline constexpr SelBinding SEL_BINDINGS[] = {
   // direct equivalents commonly found on 104-key layouts
   {58, 0x05, 0x85}, // 1. F1
   {59, 0x06, 0x86}, // 2. F2
@@ -174,7 +165,7 @@ const SelBinding SEL_BINDINGS[] = {
   {68, 0x09, 0x89}, // 11. F11
   {69, 0x0B, 0x8B}, // 12. F12
   {49, 0x58, 0xD8}, // Keyboard \ and | = 13. \	|
-  {100, 0x58, 0xD8}, // Keyboard Non-US \ and | = 13. \	|
+  // Keyboard Non-US \ and | depends on the layout (see layout.h)
   {76, 0x42, 0xC2}, // 14. Delete
   {83, 0x62, 0xE2}, // 20. Num Lock
   {41, 0x1D, 0x9D}, // 23. Esc
@@ -204,7 +195,7 @@ const SelBinding SEL_BINDINGS[] = {
   {24, 0x3C, 0xBC}, // 50. U
   {12, 0x3D, 0xBD}, // 51. I
   {18, 0x3E, 0xBE}, // 52. O
-  {19, 0x3F, 0xEF}, // 53. P
+  {19, 0x3F, 0xBF}, // 53. P
   {47, 0x40, 0xC0}, // 54. [	{
   {48, 0x41, 0xC1}, // 55. ]	}
   {40, 0x59, 0xD9}, // Keyboard Return (ENTER) (*not* “Keyboard Return”) → 56. Return
@@ -272,7 +263,7 @@ const SelBinding SEL_BINDINGS[] = {
   {101, 0x43, 0xC3}, // context menu aka “Keyboard Application” → 101. Compose
 };
 
-const DvSelBinding DV_SEL_BINDINGS[] = {
+inline constexpr DvSelBinding DV_SEL_BINDINGS[] = {
   // no equivalent USB HID code; by analogy with Windows Alt+Esc
   {1u << 4, 41, 0x31, 0xB1}, // CtrlR+Esc → 41. Front
 
@@ -317,4 +308,79 @@ const DvSelBinding DV_SEL_BINDINGS[] = {
   {1u << 4, 19, 0x30, 0xB0}, // CtrlR+P → bf(13) Power
 };
 
+// checked at compile time for all binding tables, including layout.h.
+template <typename Binding, size_t N>
+constexpr bool breaksMatchMakes(const Binding (&bindings)[N]) {
+  for (const auto &binding : bindings)
+    if (binding.sunkMake == 0 || !!(binding.sunkMake & SUNK_BREAK_BIT)
+      || binding.sunkBreak != (binding.sunkMake | SUNK_BREAK_BIT))
+      return false;
+  return true;
+}
+
+template <typename Binding, size_t N>
+constexpr bool keysAreUnique(const Binding (&bindings)[N], uint8_t Binding::*key) {
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = i + 1; j < N; j++)
+      if (bindings[i].*key == bindings[j].*key)
+        return false;
+  return true;
+}
+
+template <size_t N>
+constexpr bool modifiersAreSingleKeys(const DvBinding (&bindings)[N]) {
+  for (const auto &binding : bindings)
+    if (binding.usbkModifier == 0 || !!(binding.usbkModifier & (binding.usbkModifier - 1)))
+      return false;
+  return true;
+}
+
+// special bindings are looked up by selector alone (see DefaultView).
+template <size_t N>
+constexpr bool modifiersAreCtrlR(const DvSelBinding (&bindings)[N]) {
+  for (const auto &binding : bindings)
+    if (binding.usbkModifier != USBK_CTRL_R)
+      return false;
+  return true;
+}
+
+static_assert(breaksMatchMakes(DV_BINDINGS), "DV_BINDINGS: sunkBreak must be sunkMake | SUNK_BREAK_BIT");
+static_assert(breaksMatchMakes(SEL_BINDINGS), "SEL_BINDINGS: sunkBreak must be sunkMake | SUNK_BREAK_BIT");
+static_assert(breaksMatchMakes(DV_SEL_BINDINGS), "DV_SEL_BINDINGS: sunkBreak must be sunkMake | SUNK_BREAK_BIT");
+static_assert(modifiersAreSingleKeys(DV_BINDINGS), "DV_BINDINGS: usbkModifier must be one modifier bit");
+static_assert(keysAreUnique(DV_BINDINGS, &DvBinding::usbkModifier), "DV_BINDINGS: duplicate usbkModifier");
+static_assert(keysAreUnique(SEL_BINDINGS, &SelBinding::usbkSelector), "SEL_BINDINGS: duplicate usbkSelector");
+static_assert(modifiersAreCtrlR(DV_SEL_BINDINGS), "DV_SEL_BINDINGS: only CtrlR is supported");
+static_assert(keysAreUnique(DV_SEL_BINDINGS, &DvSelBinding::usbkSelector), "DV_SEL_BINDINGS: duplicate usbkSelector");
+
+// built at compile time for each layout (see layout.h), with any bindings
+// that differ from SEL_BINDINGS in that layout. indexed by usb modifier bit
+// (dv) or usb selector (sel and special), so one entry serves each key.
+struct UsbkToSunk {
+  struct Entry {
+    uint8_t dv;
+    uint8_t sel;
+    uint8_t special;
+  };
+  Entry entries[256]{};
+
+  constexpr UsbkToSunk(const SelBinding *selOverrides, size_t selOverrideCount) {
+    for (const auto &binding : DV_BINDINGS)
+      entries[binding.usbkModifier].dv = binding.sunkMake;
+
+    for (const auto &binding : SEL_BINDINGS)
+      entries[binding.usbkSelector].sel = binding.sunkMake;
+    for (size_t i = 0; i < selOverrideCount; i++)
+      entries[selOverrides[i].usbkSelector].sel = selOverrides[i].sunkMake;
+
+    for (const auto &binding : DV_SEL_BINDINGS)
+      entries[binding.usbkSelector].special = binding.sunkMake;
+  }
+
+  constexpr const Entry &operator[](uint8_t usbk) const {
+    return entries[usbk];
+  }
+};
+static_assert(sizeof(UsbkToSunk::Entry) == 3);
+
 #endif
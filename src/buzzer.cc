@@ -68,9 +68,8 @@ bool Buzzer::isExpired(unsigned long t, unsigned long duration) {
 }
 
 void Buzzer::setCurrent(unsigned long t, Buzzer::State value) {
-#ifdef BUZZER_VERBOSE
-  Sprintf("buzzer: setCurrent %d\n", static_cast<int>(value));
-#endif
+  if (settings.logging(LOG_BUZZER))
+    Sprintf("buzzer: setCurrent %d\n", static_cast<int>(value));
   current = value;
   since = t;
 }
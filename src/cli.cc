@@ -1,21 +1,705 @@
 #include "cli.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <string_view>
 
+#include "control.h"
+#include "latency.h"
+#include "layout.h"
+#include "macro.h"
 #include "pinout.h"
+#include "remap.h"
+#include "settings.h"
+#include "stats.h"
 #include "sunk.h"
 #include "sunm.h"
+#include "trace.h"
+#include "usb.h"
 
-void handleCliInput(char cur) {
+namespace {
+
+constexpr size_t lineCapacity = 256;
+constexpr size_t historyCapacity = 8;
+constexpr size_t ANY = SIZE_MAX;
+
+// the words of a command line, as views into the line itself.
+struct CliArgs {
+  static constexpr size_t capacity = 16;
+  std::string_view words[capacity];
+  size_t count;
+  const char *end;
+  CliPort port; // where the command was typed
+
+  std::string_view operator[](size_t i) const {
+    return i < count ? words[i] : std::string_view{};
+  }
+
+  // from word i to the end of the line, keeping any spaces between words.
+  std::string_view rest(size_t i) const {
+    if (i >= count)
+      return {};
+    return {words[i].data(), static_cast<size_t>(end - words[i].data())};
+  }
+};
+
+struct CliCommand {
+  const char *name;
+  const char *usage; // arguments, as shown by help
+  size_t minArgs;
+  size_t maxArgs;
+  // returns false if the arguments are wrong, to print the usage.
+  bool (*handler)(const CliArgs &args);
+  const char *help; // lines after the first are indented to match
+};
+
+struct CliSetting {
+  const char *name;
+  const char *values;
+  void (*format)(char *result, size_t len);
+  bool (*set)(std::string_view value);
+};
+
+struct CliBenchmark {
+  const char *name;
+  size_t iterations;
+  void (*run)(size_t iterations);
+};
+
+}
+
+// splits a line into words at runs of spaces, without copying it. words
+// after the first CliArgs::capacity are only reachable through rest().
+static void tokenize(std::string_view line, CliArgs &result) {
+  result.count = 0;
+  result.end = line.data() + line.size();
+  size_t i = 0;
+  while (result.count < CliArgs::capacity) {
+    while (i < line.size() && line[i] == ' ')
+      i++;
+    if (i == line.size())
+      break;
+    size_t start = i;
+    while (i < line.size() && line[i] != ' ')
+      i++;
+    result.words[result.count++] = line.substr(start, i - start);
+  }
+}
+
+// parses a whole word as an unsigned number, no greater than max.
+static bool parseNumber(std::string_view word, uint32_t base, uint32_t max, uint32_t &result) {
+  if (word.empty())
+    return false;
+  uint32_t value = 0;
+  for (char c : word) {
+    uint32_t digit = c >= '0' && c <= '9' ? c - '0'
+      : c >= 'a' && c <= 'z' ? c - 'a' + 10
+      : c >= 'A' && c <= 'Z' ? c - 'A' + 10
+      : base;
+    if (digit >= base || digit > max || value > (max - digit) / base)
+      return false;
+    value = value * base + digit;
+  }
+  result = value;
+  return true;
+}
+
+// copies a word so it can be logged, since binary logging needs a nul.
+template <size_t N>
+static const char *terminated(std::string_view word, char (&buffer)[N]) {
+  size_t len = std::min(word.size(), N - 1);
+  memcpy(buffer, word.data(), len);
+  buffer[len] = '\0';
+  return buffer;
+}
+
+static bool handleTypeCommand(const CliArgs &args) {
+  std::string_view text = args.rest(1);
+  sunkSend("%.*s", static_cast<int>(text.size()), text.data());
+  return true;
+}
+
+static bool handleStopCommand(const CliArgs &args) {
+  // queue the stop key too, so it stays held around the macro.
+  std::string_view text = args.rest(1);
+  macro.press(true, SUNK_STOP);
+  if (!text.empty())
+    sunkSend("%.*s", static_cast<int>(text.size()), text.data());
+  macro.press(false, SUNK_STOP);
+  return true;
+}
+
+static bool handleEnterCommand(const CliArgs &) {
+  sunkSend(SUNK_MACRO("\n"));
+  return true;
+}
+
+static bool handleGoCommand(const CliArgs &) {
+  sunkSend(SUNK_MACRO("go\n"));
+  return true;
+}
+
+static bool handleMacroCommand(const CliArgs &args) {
+  if (args[1] == "pause") {
+    macro.pause(true);
+  } else if (args[1] == "resume") {
+    macro.pause(false);
+  } else if (args[1] == "cancel") {
+    macro.cancel();
+  } else if (args.count > 1) {
+    return false;
+  }
+  if (macro.busy())
+    Sprintf("macro: %u%%%s\n", macro.percent(), macro.isPaused() ? " (paused)" : "");
+  else
+    Sprintln("macro: idle");
+  return true;
+}
+
+static bool handleBindCommand(const CliArgs &args) {
+  uint32_t usbk, sunkMake = 0;
+  if (args.count == 2) {
+    if (args[1] != "reset")
+      return false;
+    remapReset();
+  } else if (args.count == 3) {
+    if (!parseNumber(args[1], 16, 0xFF, usbk) || usbk == 0)
+      return false;
+    if (args[2] == "default") {
+      if (!remapUnbind(usbk))
+        Sprintf("bind: %02X is not remapped\n", static_cast<unsigned>(usbk));
+    } else if (args[2] == "off" || (parseNumber(args[2], 16, 0x7E, sunkMake) && sunkMake != 0)) {
+      if (!remapBind(usbk, sunkMake))
+        Sprintf("bind: no room for more than %zu keys\n", RemapV2::capacity);
+    } else {
+      return false;
+    }
+  }
+  size_t count = 0;
+  for (const auto &entry : settings.remap.entries) {
+    if (entry.usbk == 0)
+      continue;
+    if (entry.sunkMake == 0)
+      Sprintf("bind %02X off\n", entry.usbk);
+    else
+      Sprintf("bind %02X %02X\n", entry.usbk, entry.sunkMake);
+    count++;
+  }
+  if (count == 0)
+    Sprintln("bind: no keys remapped");
+  return true;
+}
+
+static bool handleStatsCommand(const CliArgs &args) {
+  if (args[1] == "reset")
+    statsReset();
+  else if (args.count > 1)
+    return false;
+  else
+    statsDump();
+  return true;
+}
+
+static bool handleLatencyCommand(const CliArgs &args) {
+  if (args[1] == "reset")
+    latencyReset();
+  else if (args.count > 1)
+    return false;
+  else
+    latencyDump();
+  return true;
+}
+
+static bool handleHidCommand(const CliArgs &) {
+  uhidDump();
+  return true;
+}
+
+static bool handleTraceCommand(const CliArgs &args) {
+  if (args[1] == "clear")
+    traceClear();
+  else if (args.count > 1)
+    return false;
+  else
+    traceDump();
+  return true;
+}
+
+static bool handleLogCommand(const CliArgs &args) {
+  constexpr size_t categoryCount = sizeof LOG_CATEGORY_NAMES / sizeof *LOG_CATEGORY_NAMES;
+  uint32_t categories = settings.logCategories;
+  for (size_t i = 1; i < args.count; i++) {
+    std::string_view word = args[i];
+    if (word == "all") {
+      categories = (1u << categoryCount) - 1;
+      continue;
+    }
+    if (word == "none") {
+      categories = 0;
+      continue;
+    }
+    bool enable = word[0] != '-';
+    std::string_view name = word[0] == '+' || word[0] == '-' ? word.substr(1) : word;
+    size_t j = 0;
+    while (j < categoryCount && name != LOG_CATEGORY_NAMES[j])
+      j++;
+    if (j == categoryCount) {
+      char buffer[32];
+      Sprintf("unknown log category: %s\n", terminated(name, buffer));
+      return true;
+    }
+    if (enable)
+      categories |= 1u << j;
+    else
+      categories &= ~(1u << j);
+  }
+  if (categories != settings.logCategories) {
+    settings.logCategories = categories;
+    settings.write<LogCategoriesV2>(categories);
+  }
+  Sprint("log:");
+  for (size_t j = 0; j < categoryCount; j++)
+    Sprintf(" %c%s", categories & 1u << j ? '+' : '-', LOG_CATEGORY_NAMES[j]);
+  Sprintln();
+  return true;
+}
+
+static const char *const FORCE_CLICK_NAMES[] = {"no", "off", "on"};
+static const char *const MOUSE_BAUD_NAMES[] = {"1200", "2400", "4800", "9600"};
+static const char *const KEYBOARD_LAYOUT_NAMES[] = {"us", "uk", "de"};
+
+template <size_t N, typename Value>
+static const char *enumName(const char *const (&names)[N], const Value &value) {
+  auto i = static_cast<size_t>(value.current);
+  return i < N ? names[i] : "?";
+}
+
+template <typename Setting, size_t N>
+static bool setEnum(typename Setting::Value &current, const char *const (&names)[N], std::string_view word) {
+  using Value = typename Setting::Value;
+  static_assert(N == static_cast<size_t>(Value::_::VALUE_COUNT));
+  for (size_t i = 0; i < N; i++) {
+    if (word != names[i])
+      continue;
+    Value value{static_cast<typename Value::State>(i)};
+    if (!(value == current)) {
+      current = value;
+      settings.write<Setting>(current);
+    }
+    return true;
+  }
+  return false;
+}
+
+// the settings in the settings menu, plus how to print and parse them.
+static const CliSetting SETTINGS[] = {
+  {"clickDuration", "<0-100> (ms)", [](char *result, size_t len) {
+    snprintf(result, len, "%llu", static_cast<unsigned long long>(settings.clickDuration));
+  }, [](std::string_view word) {
+    uint32_t value;
+    if (!parseNumber(word, 10, 100, value))
+      return false;
+    if (value != settings.clickDuration) {
+      settings.clickDuration = value;
+      settings.write<ClickDurationV2>(settings.clickDuration);
+    }
+    return true;
+  }},
+  {"forceClick", "no|off|on", [](char *result, size_t len) {
+    snprintf(result, len, "%s", enumName(FORCE_CLICK_NAMES, settings.forceClick));
+  }, [](std::string_view word) {
+    return setEnum<ForceClickV2>(settings.forceClick, FORCE_CLICK_NAMES, word);
+  }},
+  {"mouseBaud", "1200|2400|4800|9600 (after reboot)", [](char *result, size_t len) {
+    snprintf(result, len, "%s", enumName(MOUSE_BAUD_NAMES, settings.mouseBaud));
+  }, [](std::string_view word) {
+    // the menu restarts the mouse uart, but that has to happen on core 1.
+    return setEnum<MouseBaudV2>(settings.mouseBaud, MOUSE_BAUD_NAMES, word);
+  }},
+  {"hostid", "<6 hex digits>", [](char *result, size_t len) {
+    snprintf(result, len, "%c%c%c%c%c%c",
+      settings.hostid[0], settings.hostid[1], settings.hostid[2],
+      settings.hostid[3], settings.hostid[4], settings.hostid[5]);
+  }, [](std::string_view word) {
+    HostidV2::Value value{};
+    uint32_t digit;
+    if (word.size() != sizeof value.value)
+      return false;
+    for (size_t i = 0; i < word.size(); i++) {
+      if (!parseNumber(word.substr(i, 1), 16, 15, digit))
+        return false;
+      value[i] = "0123456789ABCDEF"[digit];
+    }
+    if (value != settings.hostid) {
+      settings.hostid = value;
+      settings.write<HostidV2>(settings.hostid);
+    }
+    return true;
+  }},
+  {"keyboardLayout", "us|uk|de", [](char *result, size_t len) {
+    snprintf(result, len, "%s", enumName(KEYBOARD_LAYOUT_NAMES, settings.keyboardLayout));
+  }, [](std::string_view word) {
+    if (!setEnum<KeyboardLayoutV2>(settings.keyboardLayout, KEYBOARD_LAYOUT_NAMES, word))
+      return false;
+    remapRebuildLater();
+    return true;
+  }},
+};
+
+static const CliSetting *findSetting(std::string_view name) {
+  for (const auto &setting : SETTINGS)
+    if (name == setting.name)
+      return &setting;
+  return nullptr;
+}
+
+static void printSetting(const CliSetting &setting) {
+  char value[64];
+  setting.format(value, sizeof value);
+  Sprintf("settings: %s %s\n", setting.name, value);
+}
+
+bool cliSettingGet(std::string_view name, char *result, size_t len) {
+  const CliSetting *setting = findSetting(name);
+  if (!setting)
+    return false;
+  setting->format(result, len);
+  return true;
+}
+
+bool cliSettingSet(std::string_view name, std::string_view value) {
+  const CliSetting *setting = findSetting(name);
+  return setting && setting->set(value);
+}
+
+static bool handleSettingsCommand(const CliArgs &args) {
+  if (args.count == 1 || (args.count == 2 && args[1] == "get")) {
+    for (const auto &setting : SETTINGS)
+      printSetting(setting);
+    return true;
+  }
+  const CliSetting *setting = findSetting(args[2]);
+  if (args.count == 3 && args[1] == "get" && setting) {
+    printSetting(*setting);
+    return true;
+  }
+  if (args.count == 4 && args[1] == "set" && setting) {
+    if (!setting->set(args[3])) {
+      Sprintf("settings: %s must be %s\n", setting->name, setting->values);
+      return true;
+    }
+    printSetting(*setting);
+    return true;
+  }
+  if (args.count >= 3 && !setting) {
+    Sprint("settings: names are");
+    for (const auto &each : SETTINGS)
+      Sprintf(" %s", each.name);
+    Sprintln();
+    return true;
+  }
+  return false;
+}
+
+// cheap enough to run on a live adapter without disturbing the sun, unlike
+// the benchmarks in bench.cc, which send real input.
+static const CliBenchmark BENCHMARKS[] = {
+  {"usbk_lookup", 10'000, [](size_t iterations) {
+    // the layout’s table, since the merged one belongs to core 1.
+    const UsbkToSunk &table = sunkLayout().usbkToSunk;
+    volatile uint8_t sink;
+    for (size_t i = 0; i < iterations; i++)
+      sink = table[static_cast<uint8_t>(i)].sel;
+    (void) sink;
+  }},
+  {"macro_translate", 1'000, [](size_t iterations) {
+    static const char text[] = "update-system-idprom";
+    const auto &asciiToSunk = sunkLayout().asciiToSunk;
+    volatile uint16_t sink;
+    for (size_t i = 0; i < iterations; i++)
+      for (char c : text)
+        sink = asciiToSunk[static_cast<uint8_t>(c) & 0x7F];
+    (void) sink;
+  }},
+  {"display_text", 100, [](size_t iterations) {
+    // drawn over by the next paint.
+    for (size_t i = 0; i < iterations; i++)
+      usb3sun_display_text(0, 0, false, "usb3sun 0123456789");
+  }},
+  {"latency_summary", 100, [](size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+      latencySummary(LatencyPath::KEYBOARD);
+  }},
+};
+
+static bool handleBenchCommand(const CliArgs &args) {
+  size_t count = 0;
+  for (const auto &benchmark : BENCHMARKS) {
+    if (args.count > 1 && args[1] != benchmark.name)
+      continue;
+    uint64_t start = usb3sun_micros();
+    benchmark.run(benchmark.iterations);
+    uint64_t elapsed = usb3sun_micros() - start;
+    Sprintf("bench: %-16s %8llu ns/op (%zu ops)\n", benchmark.name,
+      static_cast<unsigned long long>(elapsed * 1'000 / benchmark.iterations), benchmark.iterations);
+    count++;
+  }
+  return count > 0;
+}
+
+// paste mode types raw text from the host through the macro queue. it asks
+// the host to stop sending (xoff) while the queue is nearly full, and to
+// resume (xon) once it has drained to half, and stops reading while the queue
+// is full. over the cdc, the host then waits, so nothing is lost however fast
+// it sends. over the uart, the host must honour xon/xoff, or the uart rx
+// buffer overruns, so we count that and say so when done. only the port that
+// started the paste feeds it, so the other port can still be used meanwhile.
+static struct {
+  CliPort port;
+  bool active;
+  bool stopped; // we sent xoff
+  bool afterCr;
+  size_t queued;
+  size_t skipped;
+  size_t overruns;
+} paste{};
+// room for what the host sends before it sees the xoff, plus the uart fifos.
+constexpr size_t pasteXoffRoom = 256;
+constexpr size_t pasteXonRoom = Macro::capacity / 2;
+constexpr char XON = '\x11';
+constexpr char XOFF = '\x13';
+
+static bool handlePasteCommand(const CliArgs &args) {
+  if (paste.active) {
+    Sprintln("paste: already pasting on the other port");
+    return true;
+  }
+  paste = {};
+  paste.port = args.port;
+  paste.active = true;
+  // forget any overrun from before the paste.
+  usb3sun_debug_uart_overflow();
+  Sprintln("paste: send text, then ^D to finish or ^C to cancel (flow control is xon/xoff)");
+  return true;
+}
+
+static void finishPaste(bool cancelled) {
+  if (cancelled)
+    macro.cancel();
+  paste.active = false;
+  cliUpdate();
+  Sprintf("\npaste: %s, %zu characters queued", cancelled ? "cancelled" : "done", paste.queued);
+  if (paste.skipped > 0)
+    Sprintf(", %zu not in layout", paste.skipped);
+  if (paste.overruns > 0)
+    Sprintf(", input lost to %zu uart overruns (does your terminal honour xon/xoff?)", paste.overruns);
+  Sprintln();
+  Sprint("> ");
+}
+
+static void handlePasteInput(char cur) {
+  switch (cur) {
+    case '\x04': // ^D
+      return finishPaste(false);
+    case '\x03': // ^C
+      return finishPaste(true);
+    case '\n':
+      // terminals usually send newlines as \r, but take \r\n and \n too.
+      if (paste.afterCr) {
+        paste.afterCr = false;
+        return;
+      }
+      break;
+    case '\r':
+      cur = '\n';
+      paste.afterCr = true;
+      break;
+    default:
+      paste.afterCr = false;
+      break;
+  }
+  if (macro.paste(cur))
+    paste.queued++;
+  else
+    paste.skipped++;
+  cliUpdate();
+}
+
+bool cliReadyForInput(CliPort port) {
+  return !paste.active || paste.port != port || macro.room() > 0;
+}
+
+// written directly, and only to the pasting port, because the host needs to
+// see these immediately, and the other port’s host didn’t ask for them.
+static void pasteFlowControl(char c) {
+  if (paste.port == CliPort::CDC)
+    usb3sun_debug_cdc_write(&c, 1);
+  else
+    usb3sun_debug_uart_write(&c, 1);
+}
+
+void cliUpdate() {
+  if (!paste.active && !paste.stopped)
+    return;
+  if (paste.active && paste.port == CliPort::UART && usb3sun_debug_uart_overflow())
+    paste.overruns++;
+  size_t room = macro.room();
+  if (paste.active && !paste.stopped && room < pasteXoffRoom) {
+    pasteFlowControl(XOFF);
+    paste.stopped = true;
+  } else if (paste.stopped && (!paste.active || room >= pasteXonRoom)) {
+    pasteFlowControl(XON);
+    paste.stopped = false;
+  }
+}
+
+static char history[historyCapacity][lineCapacity]{};
+static size_t historyCount = 0;
+
+static bool handleHistoryCommand(const CliArgs &) {
+  size_t first = historyCount > historyCapacity ? historyCount - historyCapacity : 0;
+  for (size_t i = first; i < historyCount; i++)
+    Sprintf("%5zu  %s\n", i + 1, history[i % historyCapacity]);
+  return true;
+}
+
+static bool handleHelpCommand(const CliArgs &args);
+
+static const CliCommand COMMANDS[] = {
+  {"type", "<text>", 1, ANY, handleTypeCommand, "sun keyboard: send text"},
+  {"stop", "<text>", 0, ANY, handleStopCommand, "sun keyboard: send text while holding stop (like stop a)"},
+  {"enter", "", 0, 0, handleEnterCommand, "sun keyboard: send {enter}"},
+  {"go", "", 0, 0, handleGoCommand, "sun keyboard: send go{enter}"},
+  {"paste", "", 0, 0, handlePasteCommand,
+    "sun keyboard: send text of any length from the terminal, until ^D"},
+  {"macro", "[pause|resume|cancel]", 0, 1, handleMacroCommand,
+    "sun keyboard: show (or control) the text being sent"},
+  {"bind", "[<usb> <sun|off|default>|reset]", 0, 2, handleBindCommand,
+    "sun keyboard: show (or change) keys remapped from the layout\n"
+    "(usb usage id and sun keycode in hex, modifiers are E0-E7)"},
+  {"settings", "[get [<name>]|set <name> <value>]", 0, 3, handleSettingsCommand,
+    "show (or change) the settings in the settings menu"},
+  {"stats", "[reset]", 0, 1, handleStatsCommand, "debug: show (or reset) event counts and rates"},
+  {"latency", "[reset]", 0, 1, handleLatencyCommand, "debug: show (or reset) usb-to-sun input latency"},
+  {"hid", "", 0, 0, handleHidCommand, "debug: list usb hid devices in use"},
+  {"trace", "[clear]", 0, 1, handleTraceCommand, "debug: dump (or clear) recent events, even from before reboot"},
+  {"bench", "[<name>]", 0, 1, handleBenchCommand,
+    "debug: time some hot paths without sending anything\n"
+    "(usbk_lookup macro_translate display_text latency_summary)"},
+  {"log", "[+|-]<cat>", 0, ANY, handleLogCommand,
+    "debug logging: enable or disable categories\n"
+    "(buzzer sunk sunm uhid timings progress capture all none)"},
+  {"history", "", 0, 0, handleHistoryCommand, "show recent commands (up and down arrows recall them)"},
+  {"help", "", 0, 0, handleHelpCommand, "show this help"},
+};
+
+static void printUsage(const CliCommand &command) {
+  Sprintf("usage: %s %s\n", command.name, command.usage);
+}
+
+static bool handleHelpCommand(const CliArgs &) {
+  Sprintln("alt+WASD        sun mouse: move up/down/left/right");
+  Sprintln("alt+QEZC        sun mouse: move diagonally");
+  Sprintln("alt+123         sun mouse: toggle left/middle/right button");
+  Sprintln("^H              sun keyboard: send {backspace}");
+  Sprintln("^J              sun keyboard: send {enter}");
+  for (const auto &command : COMMANDS) {
+    char synopsis[64];
+    snprintf(synopsis, sizeof synopsis, "%s %s", command.name, command.usage);
+    if (strlen(synopsis) < 16)
+      Sprintf("%-15s ", synopsis);
+    else
+      Sprintf("%s\n%16s", synopsis, "");
+    for (const char *line = command.help; *line != '\0'; ) {
+      const char *newline = strchr(line, '\n');
+      size_t len = newline ? newline - line : strlen(line);
+      char buffer[80];
+      Sprintf("%s\n", terminated({line, len}, buffer));
+      line += len;
+      if (*line == '\n') {
+        line++;
+        Sprintf("%16s", "");
+      }
+    }
+  }
+  return true;
+}
+
+static void runCommand(CliPort port, std::string_view line) {
+  CliArgs args;
+  tokenize(line, args);
+  args.port = port;
+  if (args.count == 0)
+    return;
+  for (const auto &command : COMMANDS) {
+    if (args[0] != command.name)
+      continue;
+    size_t argCount = args.count - 1;
+    if (argCount < command.minArgs || argCount > command.maxArgs || !command.handler(args))
+      printUsage(command);
+    return;
+  }
+  Sprintln("unknown command");
+}
+
+static void remember(const char *line) {
+  const char *newest = historyCount > 0 ? history[(historyCount - 1) % historyCapacity] : "";
+  if (line[0] == '\0' || strcmp(line, newest) == 0)
+    return;
+  strcpy(history[historyCount++ % historyCapacity], line);
+}
+
+// replaces the input with the command `back` entries ago (or nothing if 0).
+static size_t recall(char *input, size_t back) {
+  if (back == 0)
+    input[0] = '\0';
+  else
+    strcpy(input, history[(historyCount - back) % historyCapacity]);
+  Sprintf("\r\033[K> %s", input);
+  return strlen(input);
+}
+
+// what has been typed on each port, so input from one can’t land in the
+// middle of a line (or an escape sequence) on the other.
+static struct {
+  char input[lineCapacity];
+  size_t len;
+  size_t historyBack;
+  bool prevIsEsc;
+  bool inCsi;
+  uint64_t tPrev;
+} lines[static_cast<size_t>(CliPort::COUNT)]{};
+
+void handleCliInput(CliPort port, char cur) {
   const size_t escAltTimeout = 100'000ul;
-  static char input[256] = "";
-  static size_t len = 0;
-  static char prev = '\0';
-  static bool prevIsEsc = false;
+  auto &[input, len, historyBack, prevIsEsc, inCsi, tPrev] = lines[static_cast<size_t>(port)];
+  if (paste.active && paste.port == port)
+    return handlePasteInput(cur);
+  // control protocol frames (see control.h) start with a byte you can’t
+  // type, and only count at the start of a line on the cdc.
+  if (port == CliPort::CDC && (controlCdc.busy() || (len == 0 && !prevIsEsc && !inCsi && static_cast<uint8_t>(cur) == CONTROL_SYNC)))
+    return controlCdc.input(cur);
   auto t = usb3sun_micros();
-  static auto tPrev = t;
   static auto tMouse = t;
   auto delta = t - tPrev;
+  if (inCsi) {
+    // up and down arrows recall history. ignore any other control sequence,
+    // up to and including its final byte.
+    switch (cur) {
+      case 'A':
+        if (historyBack < std::min(historyCount, historyCapacity))
+          len = recall(input, ++historyBack);
+        break;
+      case 'B':
+        if (historyBack > 0)
+          len = recall(input, --historyBack);
+        break;
+    }
+    inCsi = !(cur >= 0x40 && cur <= 0x7E);
+    goto end;
+  }
   if (prevIsEsc) {
     if (delta < escAltTimeout) {
       bool didMouse = false;
@@ -25,6 +709,7 @@ void handleCliInput(char cur) {
       static bool middle = false;
       static bool right = false;
       switch (cur) {
+        case '[': inCsi = true; break;
         case '1': didMouse = true; left = !left; break;
         case '2': didMouse = true; middle = !middle; break;
         case '3': didMouse = true; right = !right; break;
@@ -78,67 +763,25 @@ void handleCliInput(char cur) {
       // do nothing; wait for more input
       break;
     case '\x08': // ^H
-      sunkSend("\x7F"); // DEL
+      sunkSend(SUNK_MACRO("\x7F")); // DEL
       break;
     case '\x0A': // ^J
-      sunkSend("\n");
+      sunkSend(SUNK_MACRO("\n"));
       break;
     case '\r': // enter in terminal (^M)
       Sprintf("\n");
-      if (len > 0) {
-        // split into words and count
-        char *word = input;
-        size_t wordCount = 1;
-        while (static_cast<size_t>(word - input) < sizeof input && !!(word = strchr(word, ' '))) {
-          word++[0] = '\0';
-          wordCount++;
-        }
-        // now walk through the words
-        word = input;
-        if (strcmp(word, "type") == 0) {
-          if (wordCount > 1) {
-            for (size_t i = 1; i < wordCount; i++) {
-              word += strlen(word) + 1;
-              sunkSend(i == 1 ? "%s" : " %s", word);
-            }
-          } else {
-            Sprintln("usage: type <text>");
-          }
-        } else if (strcmp(word, "stop") == 0) {
-          sunkSend(true, SUNK_STOP);
-          for (size_t i = 1; i < wordCount; i++) {
-            word += strlen(word) + 1;
-            sunkSend(word);
-          }
-          sunkSend(false, SUNK_STOP);
-        } else if (strcmp(word, "enter") == 0) {
-          sunkSend("\n");
-        } else if (strcmp(word, "go") == 0) {
-          sunkSend("go\n");
-        } else if (strcmp(word, "help") == 0) {
-          Sprintln("alt+WASD        sun mouse: move up/down/left/right");
-          Sprintln("alt+QEZC        sun mouse: move diagonally");
-          Sprintln("alt+123         sun mouse: toggle left/middle/right button");
-          Sprintln("^H              sun keyboard: send {backspace}");
-          Sprintln("^J              sun keyboard: send {enter}");
-          Sprintln("type <text>     sun keyboard: send text");
-          Sprintln("stop a          sun keyboard: send {stop+A}");
-          Sprintln("enter           sun keyboard: send {enter}");
-          Sprintln("go              sun keyboard: send go{enter}");
-        } else {
-          Sprintln("unknown command");
-        }
-      }
+      remember(input);
+      runCommand(port, {input, len});
       Sprint("> ");
       len = 0;
       input[len] = '\0';
+      historyBack = 0;
       break;
     default:
       Sprintf("\033[33m%02X\033[0m", cur);
       break;
   }
 end:
-  prev = cur;
-  prevIsEsc = prev == '\x1B';
+  prevIsEsc = cur == '\x1B';
   tPrev = t;
 }
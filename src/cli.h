@@ -3,6 +3,25 @@
 
 #include "config.h"
 
-void handleCliInput(char input);
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// the debug cli runs on both debug ports, each with its own line.
+enum class CliPort : uint8_t {
+  UART,
+  CDC,
+  COUNT,
+};
+
+void handleCliInput(CliPort port, char input);
+// false while paste mode on this port is waiting for room in the macro
+// queue, so input stays in the uart (or cdc) buffer instead of being dropped.
+bool cliReadyForInput(CliPort port);
+// core 0, from loop(): tells the host when paste mode can take more input.
+void cliUpdate();
+// the settings from the `settings` command, as text (for control.h).
+bool cliSettingGet(std::string_view name, char *result, size_t len);
+bool cliSettingSet(std::string_view name, std::string_view value);
 
 #endif
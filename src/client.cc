@@ -0,0 +1,317 @@
+#include "config.h"
+#include "client.h"
+
+#ifdef USB3SUN_HAL_LINUX_NATIVE
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+static uint64_t nowMicros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t u32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+ControlClient::~ControlClient() {
+  close();
+}
+
+bool ControlClient::open(const char *path) {
+  close();
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    perror(path);
+    return false;
+  }
+  if (S_ISSOCK(st.st_mode)) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof address.sun_path) {
+      fprintf(stderr, "%s: path too long\n", path);
+      return false;
+    }
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof address) == -1) {
+      perror(path);
+      if (fd != -1)
+        ::close(fd);
+      return false;
+    }
+    attach(fd);
+    return true;
+  }
+  int fd = ::open(path, O_RDWR | O_NOCTTY);
+  if (fd == -1) {
+    perror(path);
+    return false;
+  }
+  // frames are binary, so no line discipline, echo, or xon/xoff.
+  struct termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  attach(fd);
+  return true;
+}
+
+void ControlClient::attach(int fd) {
+  close();
+  this->fd = fd;
+  decoder = {};
+}
+
+void ControlClient::close() {
+  if (fd != -1)
+    ::close(fd);
+  fd = -1;
+}
+
+ControlStatus ControlClient::call(ControlType type, const void *payload, size_t len, ControlFrame &response) {
+  response.len = 0;
+  if (fd == -1 || len > CONTROL_MAX_PAYLOAD)
+    return ControlStatus::NO_RESPONSE;
+  static ControlFrame request;
+  request.type = static_cast<uint8_t>(type);
+  request.seq = ++seq;
+  request.len = len;
+  memcpy(request.payload, payload, len);
+  uint8_t buffer[CONTROL_MAX_FRAME];
+  size_t frameLen = controlEncode(request, buffer);
+  for (size_t i = 0; i < frameLen;) {
+    ssize_t written = write(fd, &buffer[i], frameLen - i);
+    if (written <= 0) {
+      perror("control: write");
+      return ControlStatus::NO_RESPONSE;
+    }
+    i += written;
+  }
+  uint64_t deadline = nowMicros() + timeoutMillis * 1'000ull;
+  while (true) {
+    uint64_t now = nowMicros();
+    pollfd pfd{fd, POLLIN, 0};
+    if (now >= deadline || poll(&pfd, 1, (deadline - now + 999) / 1'000) != 1)
+      return ControlStatus::NO_RESPONSE;
+    ssize_t got = read(fd, buffer, sizeof buffer);
+    if (got <= 0)
+      return ControlStatus::NO_RESPONSE;
+    for (ssize_t i = 0; i < got; i++) {
+      if (decoder.feed(buffer[i], nowMicros()) != ControlDecoder::Result::FRAME)
+        continue;
+      const ControlFrame &frame = decoder.frame;
+      // responses to earlier requests that timed out are stale.
+      if (frame.seq != request.seq || frame.len < 1)
+        continue;
+      if (frame.type != (request.type | CONTROL_RESPONSE)
+        && frame.type != (static_cast<uint8_t>(ControlType::ERROR) | CONTROL_RESPONSE))
+        continue;
+      // bytes after the response would be debug output or stale, since we
+      // only ever have one request outstanding.
+      response = frame;
+      return static_cast<ControlStatus>(frame.payload[0]);
+    }
+  }
+}
+
+ControlStatus ControlClient::ping(const std::string &data) {
+  static ControlFrame response;
+  ControlStatus status = call(ControlType::PING, data.data(), data.size(), response);
+  if (status == ControlStatus::OK && std::string(&response.payload[1], &response.payload[response.len]) != data)
+    return ControlStatus::BAD_FRAME;
+  return status;
+}
+
+ControlStatus ControlClient::keys(const std::vector<uint8_t> &codes, uint16_t *room) {
+  static ControlFrame response;
+  ControlStatus status = call(ControlType::KEYS, codes.data(), codes.size(), response);
+  if (room && response.len >= 3)
+    *room = response.payload[1] | response.payload[2] << 8;
+  return status;
+}
+
+ControlStatus ControlClient::mouse(int8_t dx, int8_t dy, uint8_t buttons) {
+  static ControlFrame response;
+  uint8_t payload[] = {static_cast<uint8_t>(dx), static_cast<uint8_t>(dy), buttons};
+  return call(ControlType::MOUSE, payload, sizeof payload, response);
+}
+
+ControlStatus ControlClient::stats(std::vector<uint32_t> &result) {
+  static ControlFrame response;
+  ControlStatus status = call(ControlType::STATS, nullptr, 0, response);
+  result.clear();
+  if (status != ControlStatus::OK)
+    return status;
+  size_t count = response.len >= 2 ? response.payload[1] : 0;
+  for (size_t i = 0; i < count && 2 + i * 4 + 4 <= response.len; i++)
+    result.push_back(u32(&response.payload[2 + i * 4]));
+  return status;
+}
+
+ControlStatus ControlClient::settingGet(const std::string &name, std::string &value) {
+  static ControlFrame response;
+  ControlStatus status = call(ControlType::SETTING_GET, name.data(), name.size(), response);
+  value.clear();
+  if (status == ControlStatus::OK)
+    value.assign(&response.payload[1], &response.payload[response.len]);
+  return status;
+}
+
+ControlStatus ControlClient::settingSet(const std::string &name, const std::string &value) {
+  static ControlFrame response;
+  std::string payload = name + " " + value;
+  return call(ControlType::SETTING_SET, payload.data(), payload.size(), response);
+}
+
+ControlStatus ControlClient::trace(uint8_t core, uint32_t &cursor, std::vector<TraceEntry> &result) {
+  static ControlFrame response;
+  uint8_t payload[] = {
+    core,
+    static_cast<uint8_t>(cursor), static_cast<uint8_t>(cursor >> 8),
+    static_cast<uint8_t>(cursor >> 16), static_cast<uint8_t>(cursor >> 24),
+  };
+  ControlStatus status = call(ControlType::TRACE, payload, sizeof payload, response);
+  result.clear();
+  if (status != ControlStatus::OK || response.len < 6)
+    return status;
+  cursor = u32(&response.payload[2]);
+  for (size_t i = 6; i + CONTROL_TRACE_ENTRY_SIZE <= response.len; i += CONTROL_TRACE_ENTRY_SIZE) {
+    const uint8_t *p = &response.payload[i];
+    TraceEntry entry{};
+    entry.micros = u32(p);
+    entry.event = static_cast<TraceEvent>(p[4]);
+    entry.boot = p[5];
+    entry.len = p[6];
+    memcpy(entry.data, &p[7], sizeof entry.data);
+    result.push_back(entry);
+  }
+  return status;
+}
+
+const char *controlStatusName(ControlStatus status) {
+  switch (status) {
+    case ControlStatus::OK: return "ok";
+    case ControlStatus::BAD_FRAME: return "bad frame";
+    case ControlStatus::UNKNOWN_TYPE: return "unknown type";
+    case ControlStatus::BAD_REQUEST: return "bad request";
+    case ControlStatus::BUSY: return "busy";
+    case ControlStatus::NO_RESPONSE: return "no response";
+  }
+  return "?";
+}
+
+static void printTraceEntry(uint8_t core, const TraceEntry &entry) {
+  printf("boot %u core %u %10lu us: %s", entry.boot, core,
+    static_cast<unsigned long>(entry.micros), traceEventName(entry.event));
+  size_t len = std::min(static_cast<size_t>(entry.len), sizeof entry.data);
+  switch (entry.event) {
+    case TraceEvent::VIEW_PUSH:
+    case TraceEvent::VIEW_POP:
+    case TraceEvent::SETTINGS_WRITE:
+      printf(" %.*s", static_cast<int>(len), reinterpret_cast<const char *>(entry.data));
+      break;
+    default:
+      for (size_t i = 0; i < len; i++)
+        printf(" %02Xh", entry.data[i]);
+  }
+  printf("%s\n", entry.len > sizeof entry.data ? " ..." : "");
+}
+
+static int controlUsage() {
+  fprintf(stderr, "usage: path/to/program control <socket|tty> <command> [args]\n");
+  fprintf(stderr, "...where command can be one of:\n");
+  fprintf(stderr, "    ping [text]\n");
+  fprintf(stderr, "    keys <sun make or break in hex>...\n");
+  fprintf(stderr, "    mouse <dx> <dy> [buttons]\n");
+  fprintf(stderr, "    stats\n");
+  fprintf(stderr, "    get <setting>\n");
+  fprintf(stderr, "    set <setting> <value>\n");
+  fprintf(stderr, "    trace [--follow]\n");
+  return 1;
+}
+
+static int controlResult(ControlStatus status) {
+  if (status == ControlStatus::OK)
+    return 0;
+  fprintf(stderr, "control: %s\n", controlStatusName(status));
+  return 1;
+}
+
+int controlMain(const char *path, int argc, char **argv) {
+  if (argc < 1)
+    return controlUsage();
+  ControlClient client{};
+  if (!client.open(path))
+    return 1;
+  const char *command = argv[0];
+  if (!strcmp(command, "ping") && argc <= 2) {
+    return controlResult(client.ping(argc == 2 ? argv[1] : "usb3sun"));
+  } else if (!strcmp(command, "keys") && argc >= 2) {
+    std::vector<uint8_t> codes{};
+    for (int i = 1; i < argc; i++)
+      codes.push_back(strtoul(argv[i], nullptr, 16));
+    uint16_t room = 0;
+    ControlStatus status = client.keys(codes, &room);
+    if (status == ControlStatus::OK || status == ControlStatus::BUSY)
+      printf("macro queue room: %u\n", room);
+    return controlResult(status);
+  } else if (!strcmp(command, "mouse") && (argc == 3 || argc == 4)) {
+    return controlResult(client.mouse(atoi(argv[1]), atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 0));
+  } else if (!strcmp(command, "stats") && argc == 1) {
+    std::vector<uint32_t> values{};
+    ControlStatus status = client.stats(values);
+    for (size_t i = 0; i < values.size(); i++)
+      printf("%-22s %10lu\n", statName(static_cast<Stat>(i)), static_cast<unsigned long>(values[i]));
+    return controlResult(status);
+  } else if (!strcmp(command, "get") && argc == 2) {
+    std::string value{};
+    ControlStatus status = client.settingGet(argv[1], value);
+    if (status == ControlStatus::OK)
+      printf("%s\n", value.c_str());
+    return controlResult(status);
+  } else if (!strcmp(command, "set") && argc == 3) {
+    return controlResult(client.settingSet(argv[1], argv[2]));
+  } else if (!strcmp(command, "trace") && (argc == 1 || (argc == 2 && !strcmp(argv[1], "--follow")))) {
+    bool follow = argc == 2;
+    uint32_t cursors[2]{};
+    std::vector<TraceEntry> entries{};
+    do {
+      bool any = false;
+      for (uint8_t core = 0; core < 2; core++) {
+        do {
+          ControlStatus status = client.trace(core, cursors[core], entries);
+          if (status != ControlStatus::OK)
+            return controlResult(status);
+          for (const auto &entry : entries)
+            printTraceEntry(core, entry);
+          any |= !entries.empty();
+        } while (!entries.empty());
+      }
+      fflush(stdout);
+      if (follow && !any)
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    } while (follow);
+    return 0;
+  }
+  return controlUsage();
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef USB3SUN_CLIENT_H
+#define USB3SUN_CLIENT_H
+
+#include "config.h"
+
+#ifdef USB3SUN_HAL_LINUX_NATIVE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "control.h"
+#include "trace.h"
+
+// the host side of the control protocol (see control.h), for test rigs and
+// `program control`. one request at a time, waiting for each response.
+struct ControlClient {
+  int fd = -1;
+  uint8_t seq = 0;
+  int timeoutMillis = 1'000;
+  ControlDecoder decoder{};
+
+  ~ControlClient();
+  // a unix socket (like `program demo --control`), or a tty (like the debug
+  // cdc of a real adapter, /dev/ttyACM0 or similar).
+  bool open(const char *path);
+  // takes ownership of a connected fd, like one end of a socketpair.
+  void attach(int fd);
+  void close();
+
+  // sends a request and returns the status of its response, skipping any
+  // debug output and stale responses along the way.
+  ControlStatus call(ControlType type, const void *payload, size_t len, ControlFrame &response);
+
+  ControlStatus ping(const std::string &data);
+  // sun makes (code) and breaks (code | 80h). room is what’s left in the
+  // macro queue, so callers can pace themselves to avoid BUSY.
+  ControlStatus keys(const std::vector<uint8_t> &codes, uint16_t *room = nullptr);
+  // buttons are 1 left, 2 middle, 4 right.
+  ControlStatus mouse(int8_t dx, int8_t dy, uint8_t buttons);
+  ControlStatus stats(std::vector<uint32_t> &result);
+  ControlStatus settingGet(const std::string &name, std::string &value);
+  ControlStatus settingSet(const std::string &name, const std::string &value);
+  // entries from the given core, from cursor (0 for the oldest), updating
+  // cursor to continue from on the next call.
+  ControlStatus trace(uint8_t core, uint32_t &cursor, std::vector<TraceEntry> &result);
+};
+
+const char *controlStatusName(ControlStatus status);
+
+// `program control <path> <command> [args]`, where args are the rest of the
+// command line. returns a process exit status.
+int controlMain(const char *path, int argc, char **argv);
+
+#endif
+
+#endif
@@ -5,12 +5,10 @@
 #define DEBUG_OVER_UART         // log to Serial1 (UART0); includes TinyUSB debugging
                                 // (ignored in pinout v1 when SUNK_ENABLE is defined)
 #define DEBUG_UART_BAUD 115200  // only 115200 works with stock picoprobe firmware
+// #define DEBUG_BINARY         // log compact binary records (format string id + raw args)
+                                // instead of text; decode with `program decode firmware.elf`
 
-// #define DEBUG_TIMINGS       // log time spent on critical operations
-// #define BUZZER_VERBOSE      // log buzzer state changes for debugging
-// #define SUNK_VERBOSE        // log keyboard tx for debugging
-// #define SUNM_VERBOSE        // log mouse tx for debugging
-// #define UHID_VERBOSE        // log hid reports for debugging
+// verbose logging is configured at runtime with the `log` command in the debug cli
 
 // #define UHID_LED_ENABLE     // enable leds on usb keyboards?
 // #define UHID_LED_TEST       // blink leds on all usb keyboards
@@ -57,7 +55,12 @@
 // -DSUNM_ENABLE in platformio.ini to enable sun mouse interface
 // -DWIPE_SETTINGS in platformio.ini to wipe settings on every boot
 
-#if defined(DEBUG_LOGGING)
+#if defined(DEBUG_LOGGING) && defined(DEBUG_BINARY)
+#define Sprint(text) do { pinout.debugLog("%s", text); } while (0)
+#define Sprintln(...) do { pinout.debugLogln(__VA_ARGS__); } while (0)
+// the dead debugPrintf call keeps -Wformat checking the arguments.
+#define Sprintf(...) do { if (false) pinout.debugPrintf(__VA_ARGS__); pinout.debugLog(__VA_ARGS__); } while (0)
+#elif defined(DEBUG_LOGGING)
 #define Sprint(...) do { pinout.debugPrint(__VA_ARGS__); } while (0)
 #define Sprintln(...) do { pinout.debugPrintln(__VA_ARGS__); } while (0)
 #define Sprintf(...) do { pinout.debugPrintf(__VA_ARGS__); } while (0)
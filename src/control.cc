@@ -0,0 +1,248 @@
+#include "config.h"
+#include "control.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "cli.h"
+#include "hal.h"
+#include "macro.h"
+#include "stats.h"
+#include "sunm.h"
+#include "trace.h"
+
+ControlPort controlCdc{usb3sun_debug_cdc_write, {}};
+ControlPort controlSocket{usb3sun_control_write, {}};
+
+namespace {
+
+enum DecoderState : size_t {
+  SYNC, TYPE, SEQ, LEN_LO, LEN_HI, PAYLOAD, CRC_LO, CRC_HI,
+};
+
+// a response under construction, with the status already in place.
+struct Response {
+  ControlFrame &frame;
+
+  void status(ControlStatus status) {
+    frame.payload[0] = static_cast<uint8_t>(status);
+    frame.len = 1;
+  }
+  void u8(uint8_t value) {
+    frame.payload[frame.len++] = value;
+  }
+  void u16(uint16_t value) {
+    u8(value & 0xFF);
+    u8(value >> 8);
+  }
+  void u32(uint32_t value) {
+    u16(value & 0xFFFF);
+    u16(value >> 16);
+  }
+  void bytes(const void *data, size_t len) {
+    memcpy(&frame.payload[frame.len], data, len);
+    frame.len += len;
+  }
+};
+
+}
+
+uint16_t controlCrc(const uint8_t *data, size_t len, uint16_t crc) {
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+size_t controlEncode(const ControlFrame &frame, uint8_t (&result)[CONTROL_MAX_FRAME]) {
+  size_t len = std::min(static_cast<size_t>(frame.len), CONTROL_MAX_PAYLOAD);
+  result[0] = CONTROL_SYNC;
+  result[1] = frame.type;
+  result[2] = frame.seq;
+  result[3] = len & 0xFF;
+  result[4] = len >> 8;
+  memcpy(&result[5], frame.payload, len);
+  uint16_t crc = controlCrc(&result[1], 4 + len);
+  result[5 + len] = crc & 0xFF;
+  result[6 + len] = crc >> 8;
+  return 7 + len;
+}
+
+ControlDecoder::Result ControlDecoder::feed(uint8_t octet, uint64_t now) {
+  if (state != SYNC && now - lastMicros > timeoutMicros)
+    state = SYNC;
+  lastMicros = now;
+  if (state != SYNC && state < CRC_LO)
+    crc = controlCrc(&octet, 1, crc);
+  switch (state) {
+    case SYNC:
+      if (octet == CONTROL_SYNC) {
+        frame = {};
+        crc = 0xFFFF;
+        state = TYPE;
+      }
+      return Result::NONE;
+    case TYPE:
+      frame.type = octet;
+      state = SEQ;
+      return Result::NONE;
+    case SEQ:
+      frame.seq = octet;
+      state = LEN_LO;
+      return Result::NONE;
+    case LEN_LO:
+      frame.len = octet;
+      state = LEN_HI;
+      return Result::NONE;
+    case LEN_HI:
+      frame.len |= octet << 8;
+      got = 0;
+      if (frame.len > CONTROL_MAX_PAYLOAD) {
+        state = SYNC;
+        return Result::BAD_FRAME;
+      }
+      state = frame.len > 0 ? PAYLOAD : CRC_LO;
+      return Result::NONE;
+    case PAYLOAD:
+      frame.payload[got++] = octet;
+      if (got == frame.len)
+        state = CRC_LO;
+      return Result::NONE;
+    case CRC_LO:
+      crc ^= octet;
+      state = CRC_HI;
+      return Result::NONE;
+    case CRC_HI:
+      crc ^= octet << 8;
+      state = SYNC;
+      return crc == 0 ? Result::FRAME : Result::BAD_FRAME;
+  }
+  state = SYNC;
+  return Result::NONE;
+}
+
+bool ControlDecoder::busy(uint64_t now) const {
+  return state != SYNC && now - lastMicros <= timeoutMicros;
+}
+
+static void handleKeys(const ControlFrame &request, Response &response) {
+  for (size_t i = 0; i < request.len; i++) {
+    // idle (7Fh) and layout response (7Eh) aren’t keys.
+    uint8_t code = request.payload[i] & 0x7F;
+    if (code == 0x00 || code >= 0x7E)
+      return response.status(ControlStatus::BAD_REQUEST);
+  }
+  // only core 1 takes entries out of the queue, so the room can only grow.
+  if (macro.room() < request.len) {
+    response.status(ControlStatus::BUSY);
+  } else {
+    for (size_t i = 0; i < request.len; i++)
+      macro.press(!(request.payload[i] & 0x80), request.payload[i] & 0x7F);
+  }
+  response.u16(std::min(macro.room(), static_cast<size_t>(UINT16_MAX)));
+}
+
+static void handleMouse(const ControlFrame &request, Response &response) {
+  if (request.len == 0 || request.len % 3 != 0)
+    return response.status(ControlStatus::BAD_REQUEST);
+  for (size_t i = 0; i < request.len; i += 3) {
+    uint8_t buttons = request.payload[i + 2];
+    sunmSend(
+      static_cast<int8_t>(request.payload[i]), static_cast<int8_t>(request.payload[i + 1]),
+      !!(buttons & 1), !!(buttons & 2), !!(buttons & 4));
+  }
+}
+
+static void handleStats(const ControlFrame &, Response &response) {
+  auto count = static_cast<size_t>(Stat::VALUE_COUNT);
+  response.u8(count);
+  for (size_t i = 0; i < count; i++)
+    response.u32(statsGet(static_cast<Stat>(i)));
+}
+
+static void handleSetting(const ControlFrame &request, Response &response) {
+  std::string_view payload{reinterpret_cast<const char *>(request.payload), request.len};
+  std::string_view name = payload;
+  if (request.type == static_cast<uint8_t>(ControlType::SETTING_SET)) {
+    size_t space = payload.find(' ');
+    if (space == payload.npos)
+      return response.status(ControlStatus::BAD_REQUEST);
+    name = payload.substr(0, space);
+    if (!cliSettingSet(name, payload.substr(space + 1)))
+      return response.status(ControlStatus::BAD_REQUEST);
+  }
+  char value[64];
+  if (!cliSettingGet(name, value, sizeof value))
+    return response.status(ControlStatus::BAD_REQUEST);
+  response.bytes(value, strlen(value));
+}
+
+static void handleTrace(const ControlFrame &request, Response &response) {
+  const uint8_t *p = request.payload;
+  if (request.len != 5 || p[0] > 1)
+    return response.status(ControlStatus::BAD_REQUEST);
+  uint32_t cursor = p[1] | p[2] << 8 | p[3] << 16 | static_cast<uint32_t>(p[4]) << 24;
+  TraceEntry entries[CONTROL_TRACE_MAX_ENTRIES];
+  size_t count = traceRead(p[0], cursor, entries, CONTROL_TRACE_MAX_ENTRIES);
+  response.u8(p[0]);
+  response.u32(cursor);
+  for (size_t i = 0; i < count; i++) {
+    response.u32(entries[i].micros);
+    response.u8(static_cast<uint8_t>(entries[i].event));
+    response.u8(entries[i].boot);
+    response.u8(entries[i].len);
+    response.bytes(entries[i].data, sizeof entries[i].data);
+  }
+}
+
+static void handle(const ControlFrame &request, ControlFrame &result) {
+  result.type = request.type | CONTROL_RESPONSE;
+  result.seq = request.seq;
+  Response response{result};
+  response.status(ControlStatus::OK);
+  switch (static_cast<ControlType>(request.type)) {
+    case ControlType::PING:
+      // leaves room for the status.
+      response.bytes(request.payload, std::min(static_cast<size_t>(request.len), CONTROL_MAX_PAYLOAD - 1));
+      break;
+    case ControlType::KEYS: handleKeys(request, response); break;
+    case ControlType::MOUSE: handleMouse(request, response); break;
+    case ControlType::STATS: handleStats(request, response); break;
+    case ControlType::SETTING_GET:
+    case ControlType::SETTING_SET:
+      handleSetting(request, response);
+      break;
+    case ControlType::TRACE: handleTrace(request, response); break;
+    default:
+      response.status(ControlStatus::UNKNOWN_TYPE);
+      break;
+  }
+}
+
+bool ControlPort::busy() const {
+  return decoder.busy(usb3sun_micros());
+}
+
+void ControlPort::input(uint8_t octet) {
+  static ControlFrame response;
+  switch (decoder.feed(octet, usb3sun_micros())) {
+    case ControlDecoder::Result::NONE:
+      return;
+    case ControlDecoder::Result::FRAME:
+      handle(decoder.frame, response);
+      break;
+    case ControlDecoder::Result::BAD_FRAME:
+      response.type = static_cast<uint8_t>(ControlType::ERROR) | CONTROL_RESPONSE;
+      response.seq = decoder.frame.seq;
+      Response{response}.status(ControlStatus::BAD_FRAME);
+      break;
+  }
+  static uint8_t buffer[CONTROL_MAX_FRAME];
+  size_t len = controlEncode(response, buffer);
+  // written directly, because the host is waiting for it, and so the frame
+  // is never split by debug output.
+  write(reinterpret_cast<const char *>(buffer), len);
+}
@@ -0,0 +1,110 @@
+#ifndef USB3SUN_CONTROL_H
+#define USB3SUN_CONTROL_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// a binary request/response protocol for test rigs and other programs, on
+// the debug cdc (next to the text cli, with responses written only to the
+// cdc) and on the hal’s control port (a unix socket in the linux hal), but
+// not on the debug uart, where a terminal would show the responses as
+// garbage. see client.h for the host side.
+//
+// every frame looks like this, with multi-byte fields little endian:
+//
+//     C5h <type> <seq> <len:2> <payload:len> <crc:2>
+//
+// where the crc is crc-16/ccitt-false over type, seq, len and payload. the
+// text cli only looks for C5h at the start of a line, and frames can be
+// surrounded by debug output, so the host skips anything that isn’t a frame
+// with a good crc. each response has the request’s seq, the request’s type
+// plus 80h, and a status (ControlStatus) as the first byte of its payload.
+constexpr uint8_t CONTROL_SYNC = 0xC5;
+constexpr size_t CONTROL_MAX_PAYLOAD = 256;
+constexpr size_t CONTROL_MAX_FRAME = 1 + 1 + 1 + 2 + CONTROL_MAX_PAYLOAD + 2;
+constexpr uint8_t CONTROL_RESPONSE = 0x80;
+// trace entries in TRACE responses are <micros:4> <event> <boot> <len>
+// <data:16>, as in TraceEntry.
+constexpr size_t CONTROL_TRACE_ENTRY_SIZE = 23;
+constexpr size_t CONTROL_TRACE_MAX_ENTRIES = 10;
+
+enum class ControlType : uint8_t {
+  // <any> → <same>
+  PING = 0x01,
+  // <sun make or break>... → <macro queue room:2>
+  // queued like a macro, so sent in order with the other keyboard input.
+  KEYS = 0x02,
+  // (<dx:i8> <dy:i8> <buttons>)... → (nothing)
+  // positive dy is down, buttons are 1 left, 2 middle, 4 right.
+  MOUSE = 0x03,
+  // (nothing) → <count> <value:4>... in the order of Stat
+  STATS = 0x04,
+  // <name> → <value>, as in the `settings` command in the debug cli
+  SETTING_GET = 0x05,
+  // <name> 20h <value> → <value>
+  SETTING_SET = 0x06,
+  // <core> <cursor:4> → <core> <cursor:4> <entry:23>...
+  // entries from the given core’s ring, starting at the cursor (0 for the
+  // oldest). poll again with the returned cursor to stream new entries.
+  TRACE = 0x07,
+  // sent in response to a frame with a bad length or crc.
+  ERROR = 0x7F,
+};
+
+enum class ControlStatus : uint8_t {
+  OK = 0x00,
+  BAD_FRAME = 0x01,
+  UNKNOWN_TYPE = 0x02,
+  BAD_REQUEST = 0x03,
+  // the macro queue is too full, so nothing was queued.
+  BUSY = 0x04,
+  // never sent; the host got no response (see ControlClient).
+  NO_RESPONSE = 0xFF,
+};
+
+struct ControlFrame {
+  uint8_t type;
+  uint8_t seq;
+  uint16_t len;
+  uint8_t payload[CONTROL_MAX_PAYLOAD];
+};
+
+uint16_t controlCrc(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+// returns the length of the frame written to result.
+size_t controlEncode(const ControlFrame &frame, uint8_t (&result)[CONTROL_MAX_FRAME]);
+
+struct ControlDecoder {
+  enum class Result { NONE, FRAME, BAD_FRAME };
+  // drops a partial frame after this long without input, so the text cli
+  // never gets stuck waiting for the rest of a frame that never comes.
+  inline static const uint64_t timeoutMicros = 100'000;
+
+  ControlFrame frame;
+  size_t state;
+  size_t got;
+  uint16_t crc;
+  uint64_t lastMicros;
+
+  // on FRAME (or BAD_FRAME, with type and seq if we got that far), the
+  // frame is valid until the next call.
+  Result feed(uint8_t octet, uint64_t now);
+  bool busy(uint64_t now) const;
+};
+
+// a transport for the firmware side of the protocol.
+struct ControlPort {
+  bool (*write)(const char *data, size_t len);
+  ControlDecoder decoder;
+
+  // in the middle of a frame, so the next byte belongs to us.
+  bool busy() const;
+  // feeds one byte, answering any complete request (core 0 only).
+  void input(uint8_t octet);
+};
+
+extern ControlPort controlCdc;
+extern ControlPort controlSocket;
+
+#endif
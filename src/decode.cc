@@ -0,0 +1,255 @@
+#include "config.h"
+#include "decode.h"
+
+#ifdef USB3SUN_HAL_LINUX_NATIVE
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <elf.h>
+
+#include "pinout.h"
+
+namespace {
+
+struct Section {
+  uint64_t address;
+  std::vector<uint8_t> data;
+};
+
+struct Image {
+  std::vector<Section> sections{};
+  std::optional<uint64_t> anchor{};
+
+  // returns the nul-terminated string at the given address, if any.
+  std::optional<std::string> string(uint64_t address) const {
+    for (const auto &section : sections) {
+      if (address >= section.address && address < section.address + section.data.size()) {
+        auto begin = section.data.begin() + (address - section.address);
+        auto end = std::find(begin, section.data.end(), '\0');
+        return std::string{begin, end};
+      }
+    }
+    return {};
+  }
+};
+
+template <typename Ehdr, typename Shdr, typename Sym>
+bool loadElf(const std::vector<uint8_t> &file, Image &image) {
+  auto in = [&file](uint64_t offset, uint64_t len) {
+    return offset <= file.size() && len <= file.size() - offset;
+  };
+  if (!in(0, sizeof(Ehdr))) return false;
+  Ehdr ehdr;
+  memcpy(&ehdr, &file[0], sizeof ehdr);
+  std::vector<Shdr> shdrs{};
+  for (size_t i = 0; i < ehdr.e_shnum; i++) {
+    uint64_t offset = ehdr.e_shoff + i * ehdr.e_shentsize;
+    if (!in(offset, sizeof(Shdr))) return false;
+    Shdr shdr;
+    memcpy(&shdr, &file[offset], sizeof shdr);
+    shdrs.push_back(shdr);
+  }
+  for (const auto &shdr : shdrs) {
+    if (shdr.sh_type == SHT_NOBITS || !(shdr.sh_flags & SHF_ALLOC)) continue;
+    if (!in(shdr.sh_offset, shdr.sh_size)) return false;
+    auto begin = file.begin() + shdr.sh_offset;
+    image.sections.push_back(Section {shdr.sh_addr, {begin, begin + shdr.sh_size}});
+  }
+  for (const auto &shdr : shdrs) {
+    if (shdr.sh_type != SHT_SYMTAB || shdr.sh_link >= shdrs.size()) continue;
+    const Shdr &strtab = shdrs[shdr.sh_link];
+    if (!in(shdr.sh_offset, shdr.sh_size) || !in(strtab.sh_offset, strtab.sh_size)) return false;
+    for (uint64_t offset = 0; offset + sizeof(Sym) <= shdr.sh_size; offset += sizeof(Sym)) {
+      Sym sym;
+      memcpy(&sym, &file[shdr.sh_offset + offset], sizeof sym);
+      if (sym.st_name >= strtab.sh_size) continue;
+      const char *name = reinterpret_cast<const char *>(&file[strtab.sh_offset + sym.st_name]);
+      if (strnlen(name, strtab.sh_size - sym.st_name) < strtab.sh_size - sym.st_name
+          && !strcmp(name, "debugFormatAnchor")) {
+        image.anchor = sym.st_value;
+      }
+    }
+  }
+  return true;
+}
+
+struct Arg {
+  uint8_t tag;
+  uint64_t value;
+  std::string text;
+};
+
+struct Reader {
+  const std::vector<uint8_t> &data;
+  size_t i = 0;
+
+  std::optional<uint8_t> byte() {
+    if (i >= data.size()) return {};
+    return data[i++];
+  }
+  std::optional<uint64_t> varint() {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      auto b = byte();
+      if (!b) return {};
+      result |= static_cast<uint64_t>(*b & 0x7F) << shift;
+      if (!(*b & 0x80)) return result;
+    }
+    return {};
+  }
+  std::optional<Arg> arg() {
+    auto tag = byte();
+    if (!tag) return {};
+    switch (*tag) {
+      case 'i':
+      case 'l':
+      case 'p':
+        if (auto value = varint()) return Arg {*tag, *value, {}};
+        return {};
+      case 'd': {
+        if (i + sizeof(double) > data.size()) return {};
+        uint64_t bits;
+        memcpy(&bits, &data[i], sizeof bits);
+        i += sizeof bits;
+        return Arg {*tag, bits, {}};
+      }
+      case 's': {
+        auto len = byte();
+        if (!len || i + *len > data.size()) return {};
+        Arg result {*tag, 0, {data.begin() + i, data.begin() + i + *len}};
+        i += *len;
+        return result;
+      }
+    }
+    return {};
+  }
+};
+
+std::string render(const std::string &format, std::vector<Arg> args) {
+  std::string result{};
+  size_t next = 0;
+  auto take = [&]() -> std::optional<Arg> {
+    if (next >= args.size()) return {};
+    return args[next++];
+  };
+  auto append = [&result](const std::string &spec, auto value) {
+    int len = snprintf(nullptr, 0, spec.c_str(), value);
+    if (len <= 0) return;
+    std::vector<char> buffer(len + 1);
+    snprintf(buffer.data(), buffer.size(), spec.c_str(), value);
+    result.append(buffer.data(), len);
+  };
+  for (size_t i = 0; i < format.size(); i++) {
+    if (format[i] != '%') {
+      result += format[i];
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion, but we ignore the length
+    // and use the size of the value that was actually recorded.
+    std::string spec{"%"};
+    size_t j = i + 1;
+    while (j < format.size() && strchr("-+ #0", format[j])) spec += format[j++];
+    while (j < format.size() && (isdigit(format[j]) || format[j] == '.')) spec += format[j++];
+    while (j < format.size() && strchr("hljztL", format[j])) j++;
+    if (j >= format.size()) break;
+    char conversion = format[j];
+    i = j;
+    if (conversion == '%') {
+      result += '%';
+      continue;
+    }
+    auto arg = take();
+    if (!arg) {
+      result += "<missing>";
+      continue;
+    }
+    switch (conversion) {
+      case 'd': case 'i':
+        if (arg->tag == 'i') append(spec + "lld", static_cast<long long>(static_cast<int32_t>(arg->value)));
+        else append(spec + "lld", static_cast<long long>(arg->value));
+        break;
+      case 'u': case 'o': case 'x': case 'X':
+        append(spec + "ll" + conversion, static_cast<unsigned long long>(arg->value));
+        break;
+      case 'c':
+        append(spec + "c", static_cast<int>(arg->value));
+        break;
+      case 's':
+        append(spec + "s", arg->text.c_str());
+        break;
+      case 'p':
+        append(spec + "#llx", static_cast<unsigned long long>(arg->value));
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+        double d;
+        memcpy(&d, &arg->value, sizeof d);
+        append(spec + conversion, d);
+      } break;
+      default:
+        result += "<bad conversion>";
+    }
+  }
+  return result;
+}
+
+}
+
+int decodeDebugLog(const char *elfPath, FILE *input, FILE *output) {
+  std::ifstream elf{elfPath, std::ios::binary};
+  std::vector<uint8_t> file{std::istreambuf_iterator<char>{elf}, {}};
+  if (!elf.good() && !elf.eof()) {
+    perror("fatal: failed to read elf");
+    return 1;
+  }
+  Image image{};
+  bool ok = false;
+  if (file.size() > EI_CLASS && !memcmp(file.data(), ELFMAG, SELFMAG)) {
+    if (file[EI_CLASS] == ELFCLASS32) ok = loadElf<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(file, image);
+    if (file[EI_CLASS] == ELFCLASS64) ok = loadElf<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(file, image);
+  }
+  if (!ok || !image.anchor) {
+    fprintf(stderr, "fatal: %s: not an elf with debugFormatAnchor (built with DEBUG_BINARY?)\n", elfPath);
+    return 1;
+  }
+
+  int c;
+  while ((c = fgetc(input)) != EOF) {
+    if (c != DebugRecord::sync) {
+      fputc(c, output);
+      continue;
+    }
+    int len = fgetc(input);
+    if (len == EOF) break;
+    std::vector<uint8_t> record(len);
+    if (fread(record.data(), 1, record.size(), input) != record.size()) break;
+    Reader reader{record};
+    auto zigzag = reader.varint();
+    if (!zigzag) {
+      fprintf(output, "<bad record>\n");
+      continue;
+    }
+    int64_t offset = static_cast<int64_t>(*zigzag >> 1) ^ -static_cast<int64_t>(*zigzag & 1);
+    auto format = image.string(*image.anchor + offset);
+    if (!format) {
+      fprintf(output, "<unknown format %+lld>\n", static_cast<long long>(offset));
+      continue;
+    }
+    std::vector<Arg> args{};
+    while (auto arg = reader.arg())
+      args.push_back(*arg);
+    fputs(render(*format, args).c_str(), output);
+  }
+  fflush(output);
+  return 0;
+}
+
+#endif
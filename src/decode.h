@@ -0,0 +1,11 @@
+#ifndef USB3SUN_DECODE_H
+#define USB3SUN_DECODE_H
+
+#include <cstdio>
+
+// decodes binary debug logging (DEBUG_BINARY) from input to output, using
+// the format strings in the given elf (the firmware that wrote the log).
+// returns a process exit status.
+int decodeDebugLog(const char *elfPath, FILE *input, FILE *output = stdout);
+
+#endif
@@ -0,0 +1,79 @@
+#include "config.h"
+
+#if defined(USB3SUN_HAL_LINUX_NATIVE) && defined(USB3SUN_FUZZ)
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cli.h"
+#include "control.h"
+#include "hal.h"
+#include "macro.h"
+#include "pinout.h"
+
+// defined in main.cc.
+void setup();
+void sunkEvent();
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len);
+
+// libFuzzer entry point. the first byte picks the harness:
+// • 0: usb hid report; next byte picks bInterfaceProtocol, rest is the report
+// • 1: sun keyboard commands from the workstation
+// • 2: debug cli input on the cdc, as (delay in ms, byte) pairs
+// • 3: control protocol input (see control.h), as if from the control socket
+// state persists between inputs (as it would on a real adapter), so crashes
+// may need the whole corpus to reproduce, not just the last input.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static bool initialised = false;
+  if (!initialised) {
+    usb3sun_test_init(0);
+    usb3sun_test_virtual_clock(true);
+    setup();
+    initialised = true;
+  }
+  if (size < 1)
+    return 0;
+
+  switch (data[0]) {
+    case 0: {
+      if (size < 2)
+        return 0;
+      usb3sun_mock_uhid_interface_protocol(data[1]);
+      // pass the fuzzer’s own buffer, so asan catches reads past the end.
+      tuh_hid_report_received_cb(1, 0, &data[2], size - 2);
+    } break;
+#ifdef SUNK_ENABLE
+    case 1: {
+      // end with a padding byte, so a trailing SUNK_LED has a status byte
+      // to read, rather than waiting forever like real hardware would.
+      std::vector<char> input{&data[1], &data[size]};
+      input.push_back('\0');
+      usb3sun_mock_sunk_read(input.data(), input.size());
+      while (usb3sun_mock_sunk_read_has_input())
+        sunkEvent();
+    } break;
+#endif
+    case 2: {
+      for (size_t i = 1; i + 1 < size; i += 2) {
+        usb3sun_test_advance_micros(data[i] * 1'000ull);
+        handleCliInput(CliPort::CDC, static_cast<char>(data[i + 1]));
+      }
+      // type out any macros, even if the input paused them.
+      macro.pause(false);
+      while (macro.busy())
+        macro.update();
+    } break;
+    case 3: {
+      for (size_t i = 1; i < size; i++)
+        controlSocket.input(data[i]);
+      // don’t let injected keys pile up from one input to the next.
+      macro.cancel();
+      macro.update();
+    } break;
+  }
+  pinout.debugFlush();
+  return 0;
+}
+
+#endif
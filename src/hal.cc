@@ -127,6 +127,9 @@ static const uint8_t adafruit_gfx_classic[]  = {
 #define SUNK_UART_V2        Serial2     // UART1
 #define SUNM_UART_V1        Serial2     // UART1
 
+#include <cstdarg>
+#include <cstdio>
+
 #include <pico/mutex.h>
 #include <pico/platform.h>
 #include <pico/time.h>
@@ -194,6 +197,10 @@ size_t usb3sun_sunk_write(uint8_t *data, size_t len) {
   return pinout.sunk->write(data, len);
 }
 
+size_t usb3sun_sunk_available_for_write(void) {
+  return pinout.sunk->availableForWrite();
+}
+
 void usb3sun_sunm_init(uint32_t baud) {
   pinout.sunm->end();
   switch (pinout.version) {
@@ -213,6 +220,10 @@ size_t usb3sun_sunm_write(uint8_t *data, size_t len) {
   return pinout.sunm->write(data, len);
 }
 
+size_t usb3sun_sunm_available_for_write(void) {
+  return pinout.sunm->availableForWrite();
+}
+
 void usb3sun_usb_init(void) {
   pio_usb_configuration_t pio_cfg = PIO_USB_DEFAULT_CONFIG;
   pio_cfg.pin_dp = USB0_DP;
@@ -278,6 +289,10 @@ int usb3sun_debug_cdc_read(void) {
   return pinout.debugCdc ? pinout.debugCdc->read() : -1;
 }
 
+bool usb3sun_debug_uart_overflow(void) {
+  return pinout.debugUart ? pinout.debugUart->overflow() : false;
+}
+
 bool usb3sun_debug_write(const char *data, size_t len) {
   bool ok = true;
   if (pinout.debugCdc) {
@@ -297,6 +312,34 @@ bool usb3sun_debug_write(const char *data, size_t len) {
   return ok;
 }
 
+bool usb3sun_debug_uart_write(const char *data, size_t len) {
+  if (!pinout.debugUart)
+    return false;
+  if (pinout.debugUart->write(data, len) < len)
+    return false;
+  pinout.debugUart->flush();
+  return true;
+}
+
+bool usb3sun_debug_cdc_write(const char *data, size_t len) {
+  if (!pinout.debugCdc)
+    return false;
+  if (pinout.debugCdc->write(data, len) < len)
+    return false;
+  pinout.debugCdc->flush();
+  return true;
+}
+
+int usb3sun_control_read(void) {
+  return -1;
+}
+
+bool usb3sun_control_write(const char *data, size_t len) {
+  (void) data;
+  (void) len;
+  return false;
+}
+
 void usb3sun_allow_debug_over_cdc(void) {
   // needs to be done manually when using FreeRTOS and/or TinyUSB
   Serial.begin(115200);
@@ -363,6 +406,10 @@ void usb3sun_reboot(void) {
   rp2040.reboot();
 }
 
+size_t usb3sun_core_id(void) {
+  return get_core_num();
+}
+
 uint64_t usb3sun_micros(void) {
   return micros();
 }
@@ -371,13 +418,21 @@ void usb3sun_sleep_micros(uint64_t micros) {
   sleep_us(micros);
 }
 
+void usb3sun_idle_micros(uint64_t micros) {
+  sleep_us(micros);
+}
+
 uint32_t usb3sun_clock_speed(void) {
   return clock_get_hz(clk_sys);
 }
 
 void usb3sun_panic(const char *format, ...) {
-  // TODO handle format args
-  panic("%s", format);
+  static char message[256];
+  va_list ap;
+  va_start(ap, format);
+  vsnprintf(message, sizeof message, format, ap);
+  va_end(ap);
+  panic("%s", message);
 }
 
 static int64_t alarm(alarm_id_t, void *callback) {
@@ -457,7 +512,10 @@ void usb3sun_display_rect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t bo
 
 #elifdef USB3SUN_HAL_LINUX_NATIVE
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -466,21 +524,51 @@ void usb3sun_display_rect(int16_t x, int16_t y, int16_t w, int16_t h, int16_t bo
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "trace.h"
 
 static struct {
   size_t version = 1;
 } pinout;
 
 static uint64_t start_micros = usb3sun_micros();
-static std::vector<Entry> history{};
+static bool virtual_clock = false;
+// arbitrary, but far from zero to catch code that assumes otherwise.
+static const uint64_t virtual_clock_start = 1'000'000'000'000;
+static uint64_t virtual_micros = virtual_clock_start;
+struct Alarm {
+  uint64_t due;
+  void (*callback)(void);
+};
+static std::vector<Alarm> virtual_alarms{};
+// like the rp2040 sio fifos: one into each core, eight words deep.
+struct Fifo {
+  std::mutex mutex;
+  std::condition_variable ready;
+  uint32_t values[8];
+  size_t head = 0;
+  size_t len = 0;
+};
+static Fifo fifos[2]{};
+static thread_local size_t core_id = 0;
+static History history{};
+static std::ostream *history_dump = nullptr;
 static uint64_t history_filter;
 static bool display_current[32][128]{};
 static bool display_next[32][128]{};
@@ -520,13 +608,166 @@ std::ostream &operator<<(std::ostream &s, const Entry &v) {
   return s << v.micros << " (@" << (v.micros - start_micros) << ") " << v.op;
 }
 
-static void push_history(Op op) {
-  if (!(std::visit([](const auto &op) { return op.id; }, op) & history_filter)) {
+std::ostream &operator<<(std::ostream &s, const History &v) {
+  for (const auto &entry : v)
+    s << entry << "\n";
+  return s;
+}
+
+// each record is the micros (8 bytes), the op id as a bit index (1 byte),
+// then the op itself: a copy of the op if it’s trivially copyable, otherwise
+// its fields as written by push_history_fields.
+namespace {
+struct HistoryBytes {
+  const void *data;
+  size_t len;
+};
+
+struct HistoryReader {
+  const uint8_t *p;
+
+  template <typename T> T get() {
+    T result;
+    memcpy(&result, p, sizeof result);
+    p += sizeof result;
+    return result;
+  }
+  std::vector<uint8_t> bytes() {
+    auto len = get<uint32_t>();
+    std::vector<uint8_t> result{p, p + len};
+    p += len;
+    return result;
+  }
+  std::string string() {
+    auto data = bytes();
+    return {data.begin(), data.end()};
+  }
+  std::optional<std::vector<uint8_t>> optionalBytes() {
+    if (!get<bool>()) return {};
+    return bytes();
+  }
+};
+}
+
+static SunkWriteOp decode(HistoryReader &r, std::in_place_type_t<SunkWriteOp>) {
+  return SunkWriteOp {r.bytes()};
+}
+
+static SunmWriteOp decode(HistoryReader &r, std::in_place_type_t<SunmWriteOp>) {
+  return SunmWriteOp {r.bytes()};
+}
+
+static FsReadOp decode(HistoryReader &r, std::in_place_type_t<FsReadOp>) {
+  // fields in a braced init list are evaluated in order.
+  return FsReadOp {r.string(), r.get<size_t>(), r.optionalBytes()};
+}
+
+static FsWriteOp decode(HistoryReader &r, std::in_place_type_t<FsWriteOp>) {
+  return FsWriteOp {r.string(), r.bytes()};
+}
+
+template <size_t I = 0>
+static Op decode(HistoryReader &r, uint64_t id) {
+  using T = std::variant_alternative_t<I, Op>;
+  if constexpr (I + 1 < std::variant_size_v<Op>) {
+    if (id != T::id)
+      return decode<I + 1>(r, id);
+  }
+  if constexpr (std::is_trivially_copyable_v<T>)
+    return r.get<T>();
+  else
+    return decode(r, std::in_place_type<T>);
+}
+
+void History::record(uint64_t micros, uint64_t id) {
+  offsets.push_back(records.size());
+  append(&micros, sizeof micros);
+  uint8_t bit = __builtin_ctzll(id);
+  append(&bit, sizeof bit);
+}
+
+void History::append(const void *data, size_t len) {
+  auto bytes = static_cast<const uint8_t *>(data);
+  records.insert(records.end(), bytes, bytes + len);
+}
+
+uint64_t History::id(size_t i) const {
+  return uint64_t{1} << records[offsets[i] + sizeof(uint64_t)];
+}
+
+Entry History::operator[](size_t i) const {
+  HistoryReader r{&records[offsets[i]]};
+  uint64_t micros = r.get<uint64_t>();
+  uint64_t id = uint64_t{1} << r.get<uint8_t>();
+  return Entry {micros, decode(r, id)};
+}
+
+History::Filtered History::filter(uint64_t mask) const {
+  return Filtered {Iterator {this, 0, mask}, Iterator {this, size(), mask}};
+}
+
+void History::clear() {
+  records.clear();
+  offsets.clear();
+}
+
+History::Iterator::Iterator(const History *history, size_t i, uint64_t mask)
+  : history(history), i(i), mask(mask) {
+  skip();
+}
+
+History::Iterator &History::Iterator::operator++() {
+  i++;
+  skip();
+  return *this;
+}
+
+void History::Iterator::skip() {
+  while (i < history->size() && !(history->id(i) & mask))
+    i++;
+}
+
+template <typename T>
+static void put_history(const T &value) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  history.append(&value, sizeof value);
+}
+
+static void put_history(const HistoryBytes &value) {
+  uint32_t len = value.len;
+  history.append(&len, sizeof len);
+  history.append(value.data, value.len);
+}
+
+static void put_history(const char *value) {
+  put_history(HistoryBytes {value, strlen(value)});
+}
+
+static void put_history(const std::optional<HistoryBytes> &value) {
+  put_history(value.has_value());
+  if (value.has_value())
+    put_history(*value);
+}
+
+template <typename T>
+static void push_history(const T &op) {
+  static_assert(std::is_trivially_copyable_v<T>, "use push_history_fields");
+  if (!(T::id & history_filter)) {
     return;
   }
-  uint64_t micros = usb3sun_micros();
-  Entry entry{micros, op};
-  history.push_back(entry);
+  history.record(usb3sun_micros(), T::id);
+  history.append(&op, sizeof op);
+}
+
+// for ops that own their data, so we can record them without copying it into
+// an Op first. must match decode for that op.
+template <typename T, typename... Fields>
+static void push_history_fields(const Fields &...fields) {
+  if (!(T::id & history_filter)) {
+    return;
+  }
+  history.record(usb3sun_micros(), T::id);
+  (put_history(fields), ...);
 }
 
 void usb3sun_test_init(uint64_t history_filter_mask) {
@@ -582,20 +823,28 @@ void usb3sun_mock_display_output(int fd) {
   mock_display_fd = fd;
 }
 
-const std::vector<Entry> &usb3sun_test_get_history(void) {
+const History &usb3sun_test_get_history(void) {
   return history;
 }
 
 void usb3sun_test_clear_history(void) {
+  if (history_dump)
+    *history_dump << history << std::flush;
   history.clear();
 }
 
+void usb3sun_test_history_dump(std::ostream *output) {
+  history_dump = output;
+}
+
 static bool exit_on_reboot = false;
 void usb3sun_test_exit_on_reboot(void) {
   exit_on_reboot = true;
 }
 
+static bool demo_mode = false;
 void usb3sun_test_terminal_demo_mode(bool enabled) {
+  demo_mode = enabled;
   struct termios termios;
   if (tcgetattr(0, &termios) == -1) {
     perror("tcgetattr");
@@ -628,6 +877,121 @@ void usb3sun_sunk_init(void) {
   push_history(SunkInitOp {});
 }
 
+// a sun keyboard or mouse line, with an optional pty (usb3sun_test_sun_ptys)
+// and an optional model of its uart tx fifo (usb3sun_test_uart_model).
+struct SunLine {
+  const char *name;
+  int fd;
+  uint32_t baud;
+  // SerialUART has a 32-byte fifo, SerialPIO has an 8-word fifo.
+  size_t depth;
+  // when the line will have finished sending everything queued so far.
+  uint64_t idleAt;
+  bool warnedAboutDrops;
+  UartStats stats;
+
+  uint64_t byteMicros() const {
+    // 8n1, so each byte takes ten bit times.
+    return 10'000'000 / baud;
+  }
+  size_t queued(uint64_t now) const {
+    return idleAt > now ? (idleAt - now + byteMicros() - 1) / byteMicros() : 0;
+  }
+};
+static SunLine sunk_line{"sun keyboard", -1, 1200, 32, 0, false, {}};
+static SunLine sunm_line{"sun mouse", -1, 9600, 32, 0, false, {}};
+static bool uart_model = false;
+
+std::ostream &operator<<(std::ostream &s, const UartStats &v) {
+  return s << v.bytes << " bytes, " << v.stalls << " stalls (" << v.stallMicros
+    << " us), max queued " << v.maxQueued;
+}
+
+static bool open_sun_pty(SunLine &line) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd == -1 || grantpt(fd) == -1 || unlockpt(fd) == -1) {
+    perror("posix_openpt");
+    return false;
+  }
+  // sun protocols are binary, so no line discipline or echo.
+  struct termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  fprintf(stderr, ">>> %s: %s\n", line.name, ptsname(fd));
+  line.fd = fd;
+  return true;
+}
+
+// writes everything, unless nobody has been reading for 100 ms.
+static void write_sun_pty(SunLine &line, const uint8_t *data, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    ssize_t result = write(line.fd, &data[written], len - written);
+    if (result > 0) {
+      written += result;
+      continue;
+    }
+    if (result == -1 && errno != EAGAIN && errno != EINTR)
+      break;
+    struct pollfd pfd{line.fd, POLLOUT, 0};
+    if (poll(&pfd, 1, 100) != 1 || pfd.revents & (POLLHUP | POLLERR))
+      break;
+  }
+  if (written < len && !line.warnedAboutDrops) {
+    fprintf(stderr, ">>> %s: dropping output (is anything reading?)\n", line.name);
+    line.warnedAboutDrops = true;
+  }
+}
+
+// like SerialUART::write and SerialPIO::write, which block until each byte
+// fits in the fifo, then always return len.
+static size_t sun_line_write(SunLine &line, const uint8_t *data, size_t len) {
+  if (uart_model) {
+    const uint64_t byteMicros = line.byteMicros();
+    for (size_t i = 0; i < len; i++) {
+      uint64_t now = usb3sun_micros();
+      if (line.queued(now) >= line.depth) {
+        // wait until the oldest byte we can fit behind has been sent.
+        uint64_t until = line.idleAt - (line.depth - 1) * byteMicros;
+        usb3sun_sleep_micros(until - now);
+        line.stats.stalls++;
+        line.stats.stallMicros += until - now;
+        now = until;
+      }
+      line.idleAt = std::max(now, line.idleAt) + byteMicros;
+      line.stats.maxQueued = std::max(line.stats.maxQueued, line.queued(now));
+    }
+  }
+  line.stats.bytes += len;
+  if (line.fd != -1)
+    write_sun_pty(line, data, len);
+  return len;
+}
+
+static size_t sun_line_available_for_write(const SunLine &line) {
+  if (!uart_model)
+    return line.depth;
+  return line.depth - std::min(line.depth, line.queued(usb3sun_micros()));
+}
+
+bool usb3sun_test_sun_ptys(void) {
+  return open_sun_pty(sunk_line) && open_sun_pty(sunm_line);
+}
+
+void usb3sun_test_uart_model(bool enabled) {
+  uart_model = enabled;
+}
+
+const UartStats &usb3sun_test_sunk_stats(void) {
+  return sunk_line.stats;
+}
+
+const UartStats &usb3sun_test_sunm_stats(void) {
+  return sunm_line.stats;
+}
+
 int usb3sun_sunk_read(void) {
   push_history(SunkReadOp {});
   if (mock_sunk_input.size() > 0) {
@@ -635,26 +999,47 @@ int usb3sun_sunk_read(void) {
     mock_sunk_input.erase(mock_sunk_input.begin());
     return result;
   }
+  uint8_t result;
+  if (sunk_line.fd != -1 && read(sunk_line.fd, &result, sizeof result) == sizeof result)
+    return result;
   return -1;
 }
 
 size_t usb3sun_sunk_write(uint8_t *data, size_t len) {
-  push_history(SunkWriteOp {{data, data+len}});
-  return 0;
+  push_history_fields<SunkWriteOp>(HistoryBytes {data, len});
+  return sun_line_write(sunk_line, data, len);
+}
+
+size_t usb3sun_sunk_available_for_write(void) {
+  return sun_line_available_for_write(sunk_line);
 }
 
 void usb3sun_sunm_init(uint32_t baud) {
   push_history(SunmInitOp {baud});
+  sunm_line.baud = baud;
+  sunm_line.depth = pinout.version == 2 ? 8 : 32;
 }
 
 size_t usb3sun_sunm_write(uint8_t *data, size_t len) {
-  push_history(SunmWriteOp {{data, data+len}});
-  return 0;
+  push_history_fields<SunmWriteOp>(HistoryBytes {data, len});
+  return sun_line_write(sunm_line, data, len);
+}
+
+size_t usb3sun_sunm_available_for_write(void) {
+  return sun_line_available_for_write(sunm_line);
 }
 
 void usb3sun_usb_init(void) {}
 
-void usb3sun_usb_task(void) {}
+void usb3sun_usb_task(void) {
+  // with real threads, usb events are the only thing that wakes core 1 early,
+  // so there’s no need to spin (see usb3sun_test_start_core1).
+  if (core_id == 1 && !virtual_clock) {
+    Fifo &fifo = fifos[1];
+    std::unique_lock lock{fifo.mutex};
+    fifo.ready.wait_for(lock, std::chrono::milliseconds{1}, [&fifo] { return fifo.len > 0; });
+  }
+}
 
 bool usb3sun_usb_vid_pid(uint8_t dev_addr, uint16_t *vid, uint16_t *pid) {
   (void) dev_addr;
@@ -697,33 +1082,135 @@ void usb3sun_debug_init(int (*printf)(const char *format, ...)) {
   (void) printf;
 }
 
-int usb3sun_debug_uart_read(void) {
-  if (fcntl(0, F_SETFL, O_NONBLOCK) == 0) {
-    uint8_t result;
-    if (read(0, &result, sizeof result) == sizeof result) {
-      return result;
-    }
+// stdin, read in bulk so pasted text doesn’t cost a syscall per byte.
+static struct {
+  uint8_t data[4096];
+  size_t next = 0;
+  size_t len = 0;
+  bool eof = false;
+} stdin_buffer{};
+
+static bool stdin_buffered(void) {
+  return stdin_buffer.next < stdin_buffer.len;
+}
+
+static int stdin_read(void) {
+  static bool nonblocking = false;
+  if (!nonblocking) {
+    int flags = fcntl(0, F_GETFL);
+    nonblocking = flags != -1 && fcntl(0, F_SETFL, flags | O_NONBLOCK) == 0;
   }
-  return -1;
+  if (!stdin_buffered() && !stdin_buffer.eof) {
+    ssize_t len = read(0, stdin_buffer.data, sizeof stdin_buffer.data);
+    stdin_buffer.next = 0;
+    stdin_buffer.len = len > 0 ? len : 0;
+    stdin_buffer.eof = len == 0;
+  }
+  return stdin_buffered() ? stdin_buffer.data[stdin_buffer.next++] : -1;
+}
+
+int usb3sun_debug_uart_read(void) {
+  return stdin_read();
 }
 
 int usb3sun_debug_cdc_read(void) {
-  // TODO: same as debug uart read in this hal, is that ok?
-  if (fcntl(0, F_SETFL, O_NONBLOCK) == 0) {
-    uint8_t result;
-    if (read(0, &result, sizeof result) == sizeof result) {
-      return result;
-    }
-  }
+  // stdin is the debug uart, and the cli keeps a line for each port, so
+  // reading it here too would split lines between them.
   return -1;
 }
 
+bool usb3sun_debug_uart_overflow(void) {
+  // stdin is a pipe or a tty, which make the writer wait instead.
+  return false;
+}
+
 bool usb3sun_debug_write(const char *data, size_t len) {
   bool ok = fwrite(data, 1, len, stdout) == len;
   fflush(stdout);
   return ok;
 }
 
+bool usb3sun_debug_uart_write(const char *data, size_t len) {
+  return usb3sun_debug_write(data, len);
+}
+
+bool usb3sun_debug_cdc_write(const char *data, size_t len) {
+  return usb3sun_debug_write(data, len);
+}
+
+// the control socket, read in bulk like stdin.
+static struct {
+  int listener = -1;
+  int fd = -1;
+  uint8_t data[4096];
+  size_t next = 0;
+  size_t len = 0;
+} control_socket{};
+
+bool usb3sun_test_control_socket(const char *path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof address.sun_path) {
+    fprintf(stderr, "control socket path too long: %s\n", path);
+    return false;
+  }
+  strcpy(address.sun_path, path);
+  unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof address) == -1 || listen(fd, 1) == -1) {
+    perror("control socket");
+    if (fd != -1)
+      close(fd);
+    return false;
+  }
+  control_socket.listener = fd;
+  fprintf(stderr, "control socket: %s\n", path);
+  return true;
+}
+
+int usb3sun_control_read(void) {
+  if (control_socket.listener == -1)
+    return -1;
+  if (control_socket.fd == -1) {
+    control_socket.fd = accept4(control_socket.listener, nullptr, nullptr, SOCK_NONBLOCK);
+    if (control_socket.fd == -1)
+      return -1;
+  }
+  if (control_socket.next == control_socket.len) {
+    ssize_t len = read(control_socket.fd, control_socket.data, sizeof control_socket.data);
+    control_socket.next = 0;
+    control_socket.len = len > 0 ? len : 0;
+    // closed (or broken), so wait for the next connection.
+    if (len == 0 || (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      close(control_socket.fd);
+      control_socket.fd = -1;
+    }
+    if (len <= 0)
+      return -1;
+  }
+  return control_socket.data[control_socket.next++];
+}
+
+bool usb3sun_control_write(const char *data, size_t len) {
+  if (control_socket.fd == -1)
+    return false;
+  while (len > 0) {
+    ssize_t written = send(control_socket.fd, data, len, MSG_NOSIGNAL);
+    if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // give up on a client that stops reading, rather than hanging core 0.
+      pollfd pfd{control_socket.fd, POLLOUT, 0};
+      if (poll(&pfd, 1, 1'000) != 1)
+        return false;
+      continue;
+    }
+    if (written <= 0)
+      return false;
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
 void usb3sun_allow_debug_over_cdc(void) {}
 
 void usb3sun_allow_debug_over_uart(void) {}
@@ -738,43 +1225,50 @@ bool usb3sun_fs_wipe(void) {
 
 bool usb3sun_fs_read(const char *path, char *data, size_t len) {
   if (!mock_fs_read) {
-    push_history(FsReadOp {path, len, {}});
+    push_history_fields<FsReadOp>(path, len, std::optional<HistoryBytes> {});
     return false;
   }
   size_t actual_len = 0xAAAAAAAAAAAAAAAA;
   if (!mock_fs_read(path, data, len, actual_len)) {
-    push_history(FsReadOp {path, len, {}});
+    push_history_fields<FsReadOp>(path, len, std::optional<HistoryBytes> {});
     return false;
   }
-  push_history(FsReadOp {path, len, {{data, data + actual_len}}});
+  push_history_fields<FsReadOp>(path, len, std::optional<HistoryBytes> {{data, actual_len}});
   return actual_len == len;
 }
 
 bool usb3sun_fs_write(const char *path, const char *data, size_t len) {
-  push_history(FsWriteOp {path, {data, data + len}});
+  push_history_fields<FsWriteOp>(path, HistoryBytes {data, len});
   return false;
 }
 
 void usb3sun_mutex_lock(usb3sun_mutex *mutex) {
-  // TODO: stub
-  (void) mutex;
+  mutex->mutex.lock();
 }
 
 void usb3sun_mutex_unlock(usb3sun_mutex *mutex) {
-  // TODO: stub
-  (void) mutex;
+  mutex->mutex.unlock();
 }
 
 bool usb3sun_fifo_push(uint32_t value) {
-  // TODO: stub
-  (void) value;
-  return false;
+  Fifo &fifo = fifos[1 - core_id];
+  std::lock_guard lock{fifo.mutex};
+  if (fifo.len == std::size(fifo.values))
+    return false;
+  fifo.values[(fifo.head + fifo.len++) % std::size(fifo.values)] = value;
+  fifo.ready.notify_one();
+  return true;
 }
 
 bool usb3sun_fifo_pop(uint32_t *result) {
-  // TODO: stub
-  (void) result;
-  return false;
+  Fifo &fifo = fifos[core_id];
+  std::lock_guard lock{fifo.mutex};
+  if (fifo.len == 0)
+    return false;
+  *result = fifo.values[fifo.head];
+  fifo.head = (fifo.head + 1) % std::size(fifo.values);
+  fifo.len--;
+  return true;
 }
 
 void usb3sun_reboot(void) {
@@ -785,8 +1279,45 @@ void usb3sun_reboot(void) {
   }
 }
 
+size_t usb3sun_core_id(void) {
+  return core_id;
+}
+
+std::thread usb3sun_test_start_core1(void (*body)(void)) {
+  return std::thread {[body] {
+    core_id = 1;
+    body();
+  }};
+}
+
+void usb3sun_test_virtual_clock(bool enabled) {
+  virtual_clock = enabled;
+  virtual_micros = virtual_clock_start;
+  virtual_alarms.clear();
+  start_micros = usb3sun_micros();
+}
+
+void usb3sun_test_advance_micros(uint64_t micros) {
+  const uint64_t until = virtual_micros + micros;
+  // fire alarms in order, with the clock at their due time, including any
+  // alarms that were added by other alarms.
+  while (true) {
+    auto next = std::min_element(virtual_alarms.begin(), virtual_alarms.end(),
+      [](const Alarm &p, const Alarm &q) { return p.due < q.due; });
+    if (next == virtual_alarms.end() || next->due > until)
+      break;
+    Alarm alarm = *next;
+    virtual_alarms.erase(next);
+    virtual_micros = std::max(virtual_micros, alarm.due);
+    alarm.callback();
+  }
+  virtual_micros = until;
+}
+
 uint64_t usb3sun_micros(void) {
-  static uint64_t result = 0;
+  if (virtual_clock)
+    return virtual_micros;
+  static thread_local uint64_t result = 0;
   struct timespec ts;
   if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
     result = (uint64_t)ts.tv_sec * 1'000'000
@@ -796,6 +1327,10 @@ uint64_t usb3sun_micros(void) {
 }
 
 void usb3sun_sleep_micros(uint64_t micros) {
+  if (virtual_clock) {
+    usb3sun_test_advance_micros(micros);
+    return;
+  }
   struct timespec ts;
   if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
     ts.tv_nsec += micros * 1'000;
@@ -807,6 +1342,35 @@ void usb3sun_sleep_micros(uint64_t micros) {
   }
 }
 
+void usb3sun_idle_micros(uint64_t micros) {
+  if (virtual_clock || !demo_mode || core_id != 0)
+    return usb3sun_sleep_micros(micros);
+  // in the demo, wake up early for input, like an interrupt would, so the
+  // demo idles without polling but still reacts immediately.
+  if (stdin_buffered() || control_socket.next < control_socket.len)
+    return;
+  // a pty with nothing on the other end is always readable (POLLHUP), and so
+  // is stdin at eof, so stop polling those, or we would never sleep. we still
+  // read them as usual, so nothing left in them is lost.
+  static bool stdin_hup = false;
+  static bool sunk_line_hup = false;
+  struct pollfd fds[]{
+    {stdin_buffer.eof || stdin_hup ? -1 : 0, POLLIN, 0},
+    {sunk_line_hup ? -1 : sunk_line.fd, POLLIN, 0},
+    {control_socket.fd == -1 ? control_socket.listener : control_socket.fd, POLLIN, 0},
+  };
+  struct timespec timeout{
+    static_cast<time_t>(micros / 1'000'000),
+    static_cast<long>(micros % 1'000'000 * 1'000),
+  };
+  // negative fds (no pty, no control socket) are ignored.
+  while (ppoll(fds, std::size(fds), &timeout, nullptr) == -1 && errno == EINTR);
+  if (fds[0].revents & POLLHUP)
+    stdin_hup = true;
+  if (fds[1].revents & POLLHUP)
+    sunk_line_hup = true;
+}
+
 uint32_t usb3sun_clock_speed(void) {
   return 120'000'000;
 }
@@ -816,13 +1380,17 @@ void usb3sun_panic(const char *format, ...) {
   va_start(ap, format);
   vfprintf(stdout, format, ap);
   va_end(ap);
+  fputc('\n', stdout);
+  fflush(stdout);
+  traceDump();
   fflush(stdout);
   abort();
 }
 
 void usb3sun_alarm(uint32_t ms, void (*callback)(void)) {
-  (void) callback;
   push_history(AlarmOp {ms});
+  if (virtual_clock)
+    virtual_alarms.push_back(Alarm {virtual_micros + ms * 1'000ull, callback});
 }
 
 bool usb3sun_gpio_read(usb3sun_pin pin) {
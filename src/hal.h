@@ -21,15 +21,23 @@ typedef struct {
   #include <hardware/sync.h>
   typedef mutex_t usb3sun_mutex;
   #define USB3SUN_MUTEX __attribute__((section(".mutex_array")))
+  // not zeroed or initialised on boot, so it survives a watchdog reboot.
+  #define USB3SUN_NOINIT __attribute__((section(".uninitialized_data")))
   #define usb3sun_dmb() __dmb()
 #elifdef USB3SUN_HAL_LINUX_NATIVE
-  struct usb3sun_mutex {};
+  extern "C++" {
+    #include <mutex>
+    // like mutex_t, not recursive, so nested locking deadlocks here too.
+    struct usb3sun_mutex { std::mutex mutex; };
+  }
   #define USB3SUN_MUTEX // empty
+  #define USB3SUN_NOINIT // empty
   #define usb3sun_dmb() do {} while (0)
 
   extern "C++" {
     #include <iostream>
     #include <optional>
+    #include <thread>
     #include <variant>
     #include <vector>
     struct PinoutV2Op { static const uint64_t id = 1 << 0; };
@@ -65,9 +73,52 @@ typedef struct {
       uint64_t micros;
       Op op;
     };
+    // history of hal operations, recorded as flat binary records in one
+    // growable buffer, so recording costs no allocations per op (amortised).
+    // entries are only decoded into Op values when you look at them.
+    class History {
+    public:
+      class Iterator {
+      public:
+        Entry operator*() const { return (*history)[i]; }
+        Iterator &operator++();
+        bool operator!=(const Iterator &other) const { return i != other.i; }
+      private:
+        friend class History;
+        Iterator(const History *history, size_t i, uint64_t mask);
+        void skip();
+        const History *history;
+        size_t i;
+        uint64_t mask;
+      };
+      // the entries whose op id is in the given mask, e.g. SunkWriteOp::id.
+      struct Filtered {
+        Iterator b, e;
+        Iterator begin() const { return b; }
+        Iterator end() const { return e; }
+      };
+
+      size_t size() const { return offsets.size(); }
+      Entry operator[](size_t i) const;
+      Iterator begin() const { return Iterator {this, 0, ~uint64_t{0}}; }
+      Iterator end() const { return Iterator {this, size(), ~uint64_t{0}}; }
+      Filtered filter(uint64_t mask) const;
+      uint64_t id(size_t i) const;
+      void clear();
+
+      // starts a new record, then append() writes its payload.
+      void record(uint64_t micros, uint64_t id);
+      void append(const void *data, size_t len);
+
+    private:
+      std::vector<uint8_t> records{};
+      std::vector<size_t> offsets{};
+    };
     std::ostream &operator<<(std::ostream &s, const std::vector<uint8_t> &v);
     std::ostream &operator<<(std::ostream &s, const Op &o);
     std::ostream &operator<<(std::ostream &s, const Entry &v);
+    // one entry per line.
+    std::ostream &operator<<(std::ostream &s, const History &v);
     template <typename T>
     std::ostream &operator<<(std::ostream &s, const std::optional<T> &v) {
       if (!v.has_value()) {
@@ -103,10 +154,37 @@ typedef struct {
     void usb3sun_mock_uhid_request_report_result(bool result);
     void usb3sun_mock_fs_read(bool (*mock)(const char *path, char *data, size_t data_len, size_t &actual_len));
     void usb3sun_mock_display_output(int fd);
-    const std::vector<Entry> &usb3sun_test_get_history(void);
+    const History &usb3sun_test_get_history(void);
     void usb3sun_test_clear_history(void);
+    // when set, the history is written to this stream before it gets cleared.
+    void usb3sun_test_history_dump(std::ostream *output);
     void usb3sun_test_exit_on_reboot(void);
     void usb3sun_test_terminal_demo_mode(bool enabled);
+    // exposes the sun keyboard and mouse lines as ptys, printing their paths.
+    bool usb3sun_test_sun_ptys(void);
+    // serves usb3sun_control_read and usb3sun_control_write on a unix socket
+    // at the given path, one connection at a time.
+    bool usb3sun_test_control_socket(const char *path);
+    // when enabled, sun keyboard and mouse writes fill a model of the uart tx
+    // fifo, which drains at the baud, and block while it’s full.
+    void usb3sun_test_uart_model(bool enabled);
+    struct UartStats {
+      uint64_t bytes;
+      // writes that blocked on a full fifo, and for how long in total.
+      uint64_t stalls;
+      uint64_t stallMicros;
+      size_t maxQueued;
+    };
+    std::ostream &operator<<(std::ostream &s, const UartStats &v);
+    const UartStats &usb3sun_test_sunk_stats(void);
+    const UartStats &usb3sun_test_sunm_stats(void);
+    // when enabled, usb3sun_micros starts at a fixed time, sleeps return
+    // immediately after advancing the clock, and alarms fire in virtual time.
+    void usb3sun_test_virtual_clock(bool enabled);
+    void usb3sun_test_advance_micros(uint64_t micros);
+    // runs body on a new thread that behaves as core 1, with its own end of
+    // the fifo and usb3sun_core_id() == 1. everything else runs as core 0.
+    std::thread usb3sun_test_start_core1(void (*body)(void));
   }
 #endif
 
@@ -116,9 +194,12 @@ void usb3sun_pinout_v2(void);
 void usb3sun_sunk_init(void);
 int usb3sun_sunk_read(void);
 size_t usb3sun_sunk_write(uint8_t *data, size_t len);
+// how many bytes we can write without blocking.
+size_t usb3sun_sunk_available_for_write(void);
 
 void usb3sun_sunm_init(uint32_t baud);
 size_t usb3sun_sunm_write(uint8_t *data, size_t len);
+size_t usb3sun_sunm_available_for_write(void);
 
 void usb3sun_usb_init(void);
 void usb3sun_usb_task(void);
@@ -131,7 +212,18 @@ bool usb3sun_uhid_set_led_report(uint8_t dev_addr, uint8_t instance, uint8_t rep
 void usb3sun_debug_init(int (*printf)(const char *format, ...));
 int usb3sun_debug_uart_read(void);
 int usb3sun_debug_cdc_read(void);
+// whether the debug uart lost input because its rx buffer was full, since
+// the last call. the cdc never loses input (the host waits instead).
+bool usb3sun_debug_uart_overflow(void);
 bool usb3sun_debug_write(const char *data, size_t len);
+// just the debug uart, which (unlike the cdc) is safe to write from core 1.
+bool usb3sun_debug_uart_write(const char *data, size_t len);
+// just the debug cdc (core 0 only).
+bool usb3sun_debug_cdc_write(const char *data, size_t len);
+// a second port just for the control protocol (see control.h), if the hal
+// has one. the cdc carries the control protocol too.
+int usb3sun_control_read(void);
+bool usb3sun_control_write(const char *data, size_t len);
 void usb3sun_allow_debug_over_cdc(void);
 void usb3sun_allow_debug_over_uart(void);
 
@@ -148,8 +240,13 @@ bool usb3sun_fifo_push(uint32_t value);
 bool usb3sun_fifo_pop(uint32_t *result);
 
 void usb3sun_reboot(void);
+// 0 for setup/loop, 1 for setup1/loop1.
+size_t usb3sun_core_id(void);
 uint64_t usb3sun_micros(void);
 void usb3sun_sleep_micros(uint64_t micros);
+// like usb3sun_sleep_micros, but may return early when there’s input for core
+// 0 (in the linux demo). for idling in loop() only.
+void usb3sun_idle_micros(uint64_t micros);
 uint32_t usb3sun_clock_speed(void);
 void usb3sun_panic(const char *format, ...);
 void usb3sun_alarm(uint32_t ms, void (*callback)(void));
@@ -135,3 +135,60 @@ void HostidView::type(unsigned char digit) {
   newHostid.value[cursorIndex] = digit;
   right();
 }
+
+unsigned decodeHex(unsigned char digit) {
+  if (digit >= '0' && digit <= '9')
+    return digit - '0';
+  if (digit >= 'A' && digit <= 'F')
+    return digit - 'A' + 10;
+  if (digit >= 'a' && digit <= 'f')
+    return digit - 'a' + 10;
+  return 0;
+}
+
+// stands in for the system type byte, which only the sun knows.
+static const int MACHINE_TYPE = -1;
+
+size_t idpromReprogramScript(char *result, size_t size, const HostidV2::Value &hostid) {
+  unsigned hostid24 = 0;
+  for (size_t i = 0; i < sizeof hostid.value; i++)
+    hostid24 = hostid24 << 4 | decodeHex(hostid.value[i]);
+  const int h2 = hostid24 >> 16 & 0xFF;
+  const int h3 = hostid24 >> 8 & 0xFF;
+  const int h4 = hostid24 >> 0 & 0xFF;
+
+  // https://funny.computer.daz.cat/sun/nvram-hostid-faq.txt
+  const int idprom[15] = {
+    // version 1, then hostid byte 1/4 (system type)
+    1, MACHINE_TYPE,
+    // ethernet address oui (always 08:00:20), then the lower half, set such
+    // that hostid bytes 2/3/4 cancel it out in the checksum
+    0x08, 0x00, 0x20, h2, h3, h4,
+    // date of manufacture, set such that the system type byte cancels it
+    // out in the checksum
+    MACHINE_TYPE, 0, 0, 0,
+    // hostid bytes 2/3/4
+    h2, h3, h4,
+  };
+  uint8_t checksum = 0;
+  for (int byte : idprom)
+    if (byte != MACHINE_TYPE)
+      checksum ^= byte;
+
+  // push the checksum and the bytes in reverse, so that the loop can pop
+  // and store byte i in iteration i.
+  size_t len = 0;
+  auto append = [&](const char *fmt, auto... args) {
+    int n = snprintf(len < size ? &result[len] : nullptr, len < size ? size - len : 0, fmt, args...);
+    len += n > 0 ? n : 0;
+  };
+  append("%x", checksum);
+  for (size_t i = sizeof idprom / sizeof *idprom; i-- > 0;) {
+    if (idprom[i] == MACHINE_TYPE)
+      append(" %s", "real-machine-type");
+    else
+      append(" %x", idprom[i]);
+  }
+  append(" %s\n", "10 0 do i mkp loop");
+  return len;
+}
@@ -4,6 +4,7 @@
 #include <cstddef>
 
 #include "settings.h"
+#include "sunk.h"
 #include "view.h"
 
 struct HostidView : View {
@@ -25,4 +26,19 @@ struct HostidView : View {
 
 extern HostidView HOSTID_VIEW;
 
+unsigned decodeHex(unsigned char digit);
+
+// writes the openboot forth that reprograms the idprom with the given hostid,
+// returning the length like snprintf. type IDPROM_REPROGRAM_EPILOGUE after it.
+size_t idpromReprogramScript(char *result, size_t size, const HostidV2::Value &hostid);
+
+constexpr auto IDPROM_REPROGRAM_EPILOGUE = sunkMacro(
+  // only needed for SS1000, but harmless otherwise
+  "update-system-idprom\n"
+  ".idprom\n"
+  "banner\n");
+
+// makes the idprom contents invalid.
+constexpr auto IDPROM_WIPE_SCRIPT = sunkMacro("f 0 do aa i mkp loop\n");
+
 #endif
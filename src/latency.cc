@@ -0,0 +1,106 @@
+#include "config.h"
+#include "latency.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "hal.h"
+#include "pinout.h"
+
+namespace {
+
+constexpr size_t pathCount = static_cast<size_t>(LatencyPath::VALUE_COUNT);
+constexpr size_t bucketCount = 32;
+
+struct Histogram {
+  // bucket 0 is [0,2) us, then bucket i is [2^i,2^(i+1)) us.
+  uint32_t buckets[bucketCount];
+  uint64_t max;
+};
+
+}
+
+// one set per core, so that recording needs no locking.
+static Histogram histograms[2][pathCount]{};
+static LatencyStamp current[2]{};
+
+static const char *const PATH_NAMES[pathCount] = {"keyboard", "mouse", "macro"};
+
+LatencyScope::LatencyScope(LatencyPath path) : LatencyScope(path, usb3sun_micros()) {}
+
+LatencyScope::LatencyScope(LatencyPath path, uint64_t since) {
+  LatencyStamp &c = current[usb3sun_core_id()];
+  previous = c;
+  c = {path, since, true};
+}
+
+LatencyScope::~LatencyScope() {
+  current[usb3sun_core_id()] = previous;
+}
+
+LatencyStamp latencyStamp() {
+  return current[usb3sun_core_id()];
+}
+
+void latencyEnd() {
+  latencyEnd(current[usb3sun_core_id()]);
+}
+
+void latencyEnd(const LatencyStamp &stamp) {
+  if (stamp.active)
+    latencyRecord(stamp.path, usb3sun_micros() - stamp.since);
+}
+
+void latencyRecord(LatencyPath path, uint64_t micros) {
+  Histogram &h = histograms[usb3sun_core_id()][static_cast<size_t>(path)];
+  size_t bucket = micros < 2 ? 0 : 63 - __builtin_clzll(micros);
+  if (bucket >= bucketCount)
+    bucket = bucketCount - 1;
+  h.buckets[bucket]++;
+  if (micros > h.max)
+    h.max = micros;
+}
+
+LatencySummary latencySummary(LatencyPath path) {
+  uint32_t buckets[bucketCount]{};
+  LatencySummary result{};
+  for (const auto &core : histograms) {
+    const Histogram &h = core[static_cast<size_t>(path)];
+    for (size_t i = 0; i < bucketCount; i++) {
+      buckets[i] += h.buckets[i];
+      result.count += h.buckets[i];
+    }
+    if (h.max > result.max)
+      result.max = h.max;
+  }
+  // the smallest bucket whose cumulative count reaches the percentile.
+  auto percentile = [&](uint32_t percent) -> uint64_t {
+    uint64_t target = (static_cast<uint64_t>(result.count) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; i++) {
+      seen += buckets[i];
+      if (seen >= target)
+        return std::min((uint64_t{2} << i) - 1, result.max);
+    }
+    return result.max;
+  };
+  if (result.count > 0) {
+    result.p50 = percentile(50);
+    result.p99 = percentile(99);
+  }
+  return result;
+}
+
+void latencyDump() {
+  for (size_t i = 0; i < pathCount; i++) {
+    LatencySummary s = latencySummary(static_cast<LatencyPath>(i));
+    Sprintf("latency: %-8s %6lu samples, p50 <= %llu us, p99 <= %llu us, max %llu us\n",
+      PATH_NAMES[i], static_cast<unsigned long>(s.count),
+      static_cast<unsigned long long>(s.p50), static_cast<unsigned long long>(s.p99),
+      static_cast<unsigned long long>(s.max));
+  }
+}
+
+void latencyReset() {
+  memset(histograms, 0, sizeof histograms);
+}
@@ -0,0 +1,60 @@
+#ifndef USB3SUN_LATENCY_H
+#define USB3SUN_LATENCY_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// end-to-end input latency, from usb report (or from when a macro entry was
+// queued) to each sun byte handed to the uart, accumulated in log2 histograms
+// per path. macro latency includes the time spent waiting in the queue.
+enum class LatencyPath : uint8_t {
+  KEYBOARD,
+  MOUSE,
+  MACRO,
+  VALUE_COUNT,
+};
+
+struct LatencySummary {
+  uint32_t count;
+  // upper bounds of the buckets containing p50 and p99, in microseconds.
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t max;
+};
+
+// the start of an input event, so it can be ended later, maybe on the other
+// core (see sunkSend).
+struct LatencyStamp {
+  LatencyPath path;
+  uint64_t since;
+  bool active;
+};
+
+// stamps the start of an input event on this core, until the scope ends.
+// nested scopes (like a macro sent from a key handler) take over, then
+// restore the outer stamp.
+struct LatencyScope {
+  LatencyScope(LatencyPath path);
+  // for events that started earlier, like queued macro entries.
+  LatencyScope(LatencyPath path, uint64_t since);
+  ~LatencyScope();
+  LatencyScope(const LatencyScope &) = delete;
+  LatencyScope &operator=(const LatencyScope &) = delete;
+
+private:
+  LatencyStamp previous;
+};
+
+// this core’s current stamp, if any.
+LatencyStamp latencyStamp();
+// call when a sun byte (or mouse packet) is handed to the uart.
+void latencyEnd();
+void latencyEnd(const LatencyStamp &stamp);
+void latencyRecord(LatencyPath path, uint64_t micros);
+LatencySummary latencySummary(LatencyPath path);
+void latencyDump();
+void latencyReset();
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef USB3SUN_LAYOUT_H
+#define USB3SUN_LAYOUT_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bindings.h"
+#include "settings.h"
+
+// internal flags (not part of real keycode)
+#define SUNK_SEND_SHIFT 0x100
+#define SHIFT(code) (SUNK_SEND_SHIFT | (code))
+
+// the us layout, which the other layouts are defined relative to.
+constexpr uint16_t ASCII_TO_SUNK[128] = {
+    /* 00h */ 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 08h */ 0, 0x35, SUNK_RETURN, 0, 0, 0, 0, 0,
+    /* 10h */ 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 18h */ 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 20h */ 0x79, SHIFT(0x1E), SHIFT(0x57), SHIFT(0x20), SHIFT(0x21), SHIFT(0x22), SHIFT(0x24), 0x57,
+    /* 28h */ SHIFT(0x26), SHIFT(0x27), SHIFT(0x25), SHIFT(0x29), 0x6B, 0x28, 0x6C, 0x6D,
+    /* 30h */ 0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,
+    /* 38h */ 0x25, 0x26, SHIFT(0x56), 0x56, SHIFT(0x6B), 0x2A, SHIFT(0x6C), SHIFT(0x6D),
+    /* 40h */ SHIFT(0x1F), SHIFT(0x4D), SHIFT(0x68), SHIFT(0x66), SHIFT(0x4F), SHIFT(0x38), SHIFT(0x50), SHIFT(0x51),
+    /* 48h */ SHIFT(0x52), SHIFT(0x3D), SHIFT(0x53), SHIFT(0x54), SHIFT(0x55), SHIFT(0x6A), SHIFT(0x69), SHIFT(0x3E),
+    /* 50h */ SHIFT(0x3F), SHIFT(0x36), SHIFT(0x39), SHIFT(0x4E), SHIFT(0x3A), SHIFT(0x3C), SHIFT(0x67), SHIFT(0x37),
+    /* 58h */ SHIFT(0x65), SHIFT(0x3B), SHIFT(0x64), 0x40, 0x58, 0x41, SHIFT(0x23), SHIFT(0x28),
+    /* 60h */ 0x2A, 0x4D, 0x68, 0x66, 0x4F, 0x38, 0x50, 0x51,
+    /* 68h */ 0x52, 0x3D, 0x53, 0x54, 0x55, 0x6A, 0x69, 0x3E,
+    /* 70h */ 0x3F, 0x36, 0x39, 0x4E, 0x3A, 0x3C, 0x67, 0x37,
+    /* 78h */ 0x65, 0x3B, 0x64, SHIFT(0x40), SHIFT(0x58), SHIFT(0x41), SHIFT(0x2A), SUNK_BACKSPACE,
+};
+
+struct AsciiBinding {
+  char ascii;
+  uint16_t sunk; // as in ASCII_TO_SUNK, or 0 if this layout can’t type it
+};
+
+// the sun keyboard layouts we can pretend to be. sun keycodes are positional,
+// so the host’s keymap decides what each key types, and layouts only differ
+// in the iso keys and in which keys our macros press to type ascii.
+struct SunkLayout {
+  uint8_t code; // sent in response to SUNK_LAYOUT
+  UsbkToSunk usbkToSunk;
+  uint16_t asciiToSunk[128];
+
+  template <size_t SelCount>
+  constexpr SunkLayout(uint8_t code, const SelBinding (&selOverrides)[SelCount])
+    : code(code), usbkToSunk(selOverrides, SelCount), asciiToSunk{} {
+    for (size_t i = 0; i < sizeof asciiToSunk / sizeof *asciiToSunk; i++)
+      asciiToSunk[i] = ASCII_TO_SUNK[i];
+  }
+
+  template <size_t SelCount, size_t AsciiCount>
+  constexpr SunkLayout(
+    uint8_t code,
+    const SelBinding (&selOverrides)[SelCount],
+    const AsciiBinding (&asciiOverrides)[AsciiCount])
+    : SunkLayout(code, selOverrides) {
+    for (const auto &binding : asciiOverrides)
+      asciiToSunk[static_cast<uint8_t>(binding.ascii)] = binding.sunk;
+  }
+};
+
+// sources:
+// illumos usr/src/uts/common/io/keytables.c (layout codes, and the uk4 and germany4 keytables)
+
+// iso keyboards have an extra key between left shift and Z, and a key between
+// ' and Return where us keyboards have \ above Return.
+inline constexpr SelBinding ISO_SEL_BINDINGS[] = {
+  {100, 0x7C, 0xFC}, // Keyboard Non-US \ and | → 124. (iso key left of Z)
+  {50, 0x58, 0xD8}, // Keyboard Non-US # and ~ → 13. (iso key left of Return)
+};
+
+inline constexpr SelBinding US_SEL_BINDINGS[] = {
+  {100, 0x58, 0xD8}, // Keyboard Non-US \ and | → 13. \	|
+};
+
+static_assert(breaksMatchMakes(ISO_SEL_BINDINGS), "ISO_SEL_BINDINGS: sunkBreak must be sunkMake | SUNK_BREAK_BIT");
+static_assert(keysAreUnique(ISO_SEL_BINDINGS, &SelBinding::usbkSelector), "ISO_SEL_BINDINGS: duplicate usbkSelector");
+static_assert(breaksMatchMakes(US_SEL_BINDINGS), "US_SEL_BINDINGS: sunkBreak must be sunkMake | SUNK_BREAK_BIT");
+
+inline constexpr AsciiBinding UK_ASCII_BINDINGS[] = {
+  {'"', SHIFT(0x1F)},
+  {'@', SHIFT(0x57)},
+  {'#', 0x58},
+  {'~', SHIFT(0x58)},
+  {'\\', 0x7C},
+  {'|', SHIFT(0x7C)},
+};
+
+// characters that need Alt Graph or a dead key can’t be typed.
+inline constexpr AsciiBinding DE_ASCII_BINDINGS[] = {
+  {'y', 0x64}, {'Y', SHIFT(0x64)},
+  {'z', 0x3B}, {'Z', SHIFT(0x3B)},
+  {'"', SHIFT(0x1F)},
+  {'&', SHIFT(0x23)},
+  {'/', SHIFT(0x24)},
+  {'(', SHIFT(0x25)},
+  {')', SHIFT(0x26)},
+  {'=', SHIFT(0x27)},
+  {'?', SHIFT(0x28)},
+  {'+', 0x41}, {'*', SHIFT(0x41)},
+  {'#', 0x58}, {'\'', SHIFT(0x58)},
+  {'<', 0x7C}, {'>', SHIFT(0x7C)},
+  {',', 0x6B}, {';', SHIFT(0x6B)},
+  {'.', 0x6C}, {':', SHIFT(0x6C)},
+  {'-', 0x6D}, {'_', SHIFT(0x6D)},
+  {'@', 0}, {'[', 0}, {']', 0}, {'{', 0}, {'}', 0},
+  {'\\', 0}, {'|', 0}, {'~', 0}, {'^', 0}, {'`', 0},
+};
+
+// in the same order as KeyboardLayout.
+inline constexpr SunkLayout SUNK_LAYOUTS[] = {
+  {0x00, US_SEL_BINDINGS}, // US4
+  {0x0E, ISO_SEL_BINDINGS, UK_ASCII_BINDINGS}, // UK4
+  {0x05, ISO_SEL_BINDINGS, DE_ASCII_BINDINGS}, // Germany4
+};
+static_assert(sizeof SUNK_LAYOUTS / sizeof *SUNK_LAYOUTS == static_cast<size_t>(KeyboardLayout::_::VALUE_COUNT));
+
+inline const SunkLayout &sunkLayout() {
+  auto i = static_cast<size_t>(settings.keyboardLayout.current);
+  return SUNK_LAYOUTS[i < sizeof SUNK_LAYOUTS / sizeof *SUNK_LAYOUTS ? i : 0];
+}
+
+#endif
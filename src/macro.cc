@@ -0,0 +1,194 @@
+#include "config.h"
+#include "macro.h"
+
+#include <utility>
+
+#include "bindings.h"
+#include "hal.h"
+#include "latency.h"
+#include "layout.h"
+#include "mutex.h"
+#include "pinout.h"
+#include "sunk.h"
+
+unsigned long Macro::typingMicros(const uint16_t *keys, size_t len) {
+  // make, break, and idle, plus shift make and break if needed. each byte is
+  // ten bits at 1200 baud (8N1).
+  unsigned long bytes = 0;
+  for (size_t i = 0; i < len; i++)
+    bytes += !!(keys[i] & SUNK_SEND_SHIFT) ? 5 : 3;
+  return bytes * 10 * 1'000'000ull / 1'200;
+}
+
+bool Macro::type(const char *text, size_t len) {
+  uint16_t entries[256];
+  if (len > sizeof entries / sizeof *entries) {
+    Sprintf("sunk: macro buffer overflow\n");
+    return false;
+  }
+  const auto &asciiToSunk = sunkLayout().asciiToSunk;
+  for (size_t i = 0; i < len; i++) {
+    auto octet = static_cast<uint8_t>(text[i]);
+    if (octet >= sizeof asciiToSunk / sizeof *asciiToSunk || asciiToSunk[octet] == 0) {
+      Sprintf("sunk: octet %02Xh not in layout\n", octet);
+      return false;
+    }
+    entries[i] = asciiToSunk[octet];
+  }
+  return type(entries, len, text);
+}
+
+bool Macro::type(const uint16_t *keys, size_t len, const char *text) {
+  if (!push(keys, len))
+    return false;
+  Sprintf("sunk: queued macro <%s>, about %lu ms\n", text, typingMicros(keys, len) / 1'000ul);
+  return true;
+}
+
+bool Macro::press(bool make, uint8_t code) {
+  uint16_t entry = (make ? PRESS : RELEASE) | code;
+  return push(&entry, 1);
+}
+
+bool Macro::paste(char c) {
+  auto octet = static_cast<uint8_t>(c);
+  const auto &asciiToSunk = sunkLayout().asciiToSunk;
+  if (octet >= sizeof asciiToSunk / sizeof *asciiToSunk || asciiToSunk[octet] == 0)
+    return false;
+  return push(&asciiToSunk[octet], 1);
+}
+
+bool Macro::push(const uint16_t *entries, size_t count) {
+  MutexGuard m{&macroMutex};
+  if (count > capacity - len) {
+    Sprintf("sunk: macro queue full\n");
+    return false;
+  }
+  if (len == 0)
+    sent = total = 0;
+  auto now = static_cast<uint32_t>(usb3sun_micros());
+  for (size_t i = 0; i < count; i++) {
+    queuedAt[(head + len) % capacity] = now;
+    queue[(head + len++) % capacity] = entries[i];
+  }
+  total += count;
+  return true;
+}
+
+void Macro::update() {
+  bool cancelled = false;
+  {
+    MutexGuard m{&macroMutex};
+    std::swap(cancelled, cancelling);
+  }
+  if (cancelled) {
+    // don’t leave the sun with keys held down (like stop in “stop a”).
+    sunkReleaseAll(KeySource::MACRO);
+    finish(true);
+    return;
+  }
+  for (size_t i = 0; i < maxEntriesPerUpdate; i++) {
+#ifdef SUNK_ENABLE
+    if (usb3sun_sunk_available_for_write() < maxEntryBytes)
+      return;
+#endif
+    uint16_t entry;
+    uint32_t since;
+    bool done;
+    {
+      MutexGuard m{&macroMutex};
+      if (paused || len == 0)
+        return;
+      entry = queue[head];
+      since = queuedAt[head];
+      head = (head + 1) % capacity;
+      len -= 1;
+      sent += 1;
+      done = len == 0;
+    }
+    uint64_t now = usb3sun_micros();
+    send(entry, now - static_cast<uint32_t>(static_cast<uint32_t>(now) - since));
+    if (done) {
+      finish(false);
+      return;
+    }
+  }
+}
+
+void Macro::send(uint16_t entry, uint64_t since) {
+  LatencyScope latency{LatencyPath::MACRO, since};
+  uint8_t code = entry & 0x7F;
+  if (!!(entry & PRESS)) {
+    sunkSend(KeySource::MACRO, true, code);
+  } else if (!!(entry & RELEASE)) {
+    sunkSend(KeySource::MACRO, false, code);
+  } else {
+    if (!!(entry & SUNK_SEND_SHIFT))
+      sunkSend(KeySource::MACRO, true, SUNK_SHIFT_L);
+    sunkSend(KeySource::MACRO, true, entry & 0xFF);
+    sunkSend(KeySource::MACRO, false, entry & 0xFF);
+    if (!!(entry & SUNK_SEND_SHIFT))
+      sunkSend(KeySource::MACRO, false, SUNK_SHIFT_L);
+  }
+}
+
+void Macro::pause(bool paused) {
+  MutexGuard m{&macroMutex};
+  if (this->paused != paused)
+    Sprintf("sunk: macro %s\n", paused ? "paused" : "resumed");
+  this->paused = paused;
+}
+
+void Macro::cancel() {
+  {
+    MutexGuard m{&macroMutex};
+    if (len == 0)
+      return;
+    Sprintf("sunk: macro cancelled after %zu of %zu keystrokes\n", sent, total);
+    head = len = 0;
+    cancelling = true;
+  }
+}
+
+void Macro::onDone(void (*callback)(bool cancelled)) {
+  {
+    MutexGuard m{&macroMutex};
+    if (len > 0 || cancelling) {
+      whenDone = callback;
+      return;
+    }
+  }
+  callback(false);
+}
+
+void Macro::finish(bool cancelled) {
+  void (*callback)(bool) = nullptr;
+  {
+    MutexGuard m{&macroMutex};
+    paused = false;
+    callback = whenDone;
+    whenDone = nullptr;
+  }
+  if (callback)
+    callback(cancelled);
+}
+
+bool Macro::busy() {
+  MutexGuard m{&macroMutex};
+  return len > 0 || cancelling;
+}
+
+size_t Macro::room() {
+  MutexGuard m{&macroMutex};
+  return capacity - len;
+}
+
+bool Macro::isPaused() {
+  MutexGuard m{&macroMutex};
+  return paused;
+}
+
+unsigned Macro::percent() {
+  MutexGuard m{&macroMutex};
+  return total > 0 ? sent * 100 / total : 100;
+}
@@ -0,0 +1,74 @@
+#ifndef USB3SUN_MACRO_H
+#define USB3SUN_MACRO_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+// queues the keystrokes of macros (see sunkSend in sunk.h), then sends them
+// from loop1() as the sun keyboard uart has room, so long macros like the
+// idprom script never block usb input or the menu for seconds at a time.
+struct Macro {
+  // each entry is an asciiToSunk value (one character, with shift if
+  // needed), or a single make or break of the given sun keycode.
+  inline static const uint16_t PRESS = 0x200;
+  inline static const uint16_t RELEASE = 0x400;
+  inline static const size_t capacity = 1024;
+  // enough room in the uart for the longest entry: shift make, make, break,
+  // shift break, idle.
+  inline static const size_t maxEntryBytes = 5;
+  // limits the work per loop1(), in case the uart never fills (linux).
+  inline static const size_t maxEntriesPerUpdate = 4;
+
+  uint16_t queue[capacity];
+  // when each entry was queued (low 32 bits of usb3sun_micros), so latency
+  // includes the wait in the queue.
+  uint32_t queuedAt[capacity];
+  size_t head;
+  size_t len;
+  // progress since the queue was last empty.
+  size_t sent;
+  size_t total;
+  bool paused;
+  // set by cancel(), so that update() on core 1 releases any keys held by
+  // the macro, never racing with an entry it’s still sending.
+  bool cancelling;
+  void (*whenDone)(bool cancelled);
+
+  // how long the sun keyboard uart will take to send the given keys.
+  static unsigned long typingMicros(const uint16_t *keys, size_t len);
+
+  // fails if the current layout can’t type any character, or the queue is
+  // full.
+  bool type(const char *text, size_t len);
+  // for text already translated for the current layout (see SUNK_MACRO).
+  bool type(const uint16_t *keys, size_t len, const char *text);
+  bool press(bool make, uint8_t code);
+  // for paste mode: queues one character without logging, failing if the
+  // current layout can’t type it or the queue is full.
+  bool paste(char c);
+  void update();
+  void pause(bool paused);
+  // drops the rest of the queue, then the next update() releases any keys
+  // held by the macro and calls the onDone callback.
+  void cancel();
+  void onDone(void (*callback)(bool cancelled));
+  bool busy();
+  // how many more entries the queue can take.
+  size_t room();
+  bool isPaused();
+  unsigned percent();
+
+private:
+  bool push(const uint16_t *entries, size_t count);
+  void send(uint16_t entry, uint64_t since);
+  void finish(bool cancelled);
+};
+
+extern Macro macro;
+extern usb3sun_mutex macroMutex;
+
+#endif
@@ -1,6 +1,11 @@
 #include "config.h"
 
+#include <algorithm>
 #include <atomic>
+#include <bitset>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
 #ifdef USB3SUN_HAL_ARDUINO_PICO
 #include <Arduino.h>
@@ -10,13 +15,23 @@
 #include "bindings.h"
 #include "buzzer.h"
 #include "cli.h"
+#include "client.h"
+#include "control.h"
+#include "decode.h"
 #include "hal.h"
+#include "latency.h"
+#include "layout.h"
+#include "macro.h"
 #include "menu.h"
 #include "pinout.h"
+#include "remap.h"
+#include "replay.h"
 #include "settings.h"
 #include "state.h"
+#include "stats.h"
 #include "sunm.h"
 #include "sunk.h"
+#include "trace.h"
 #include "usb.h"
 #include "view.h"
 
@@ -35,18 +50,35 @@ enum class Message : uint32_t {
   UHID_LED_ALL_ON,
 };
 
-// core 1 only
+// core 1 only, except that uhidDump reads which devices are present (with
+// hidMutex, which mount and unmount hold while changing them).
 struct {
   bool present = false;
   uint8_t dev_addr;
   uint8_t instance;
   uint8_t if_protocol;
+  uint16_t vid;
+  uint16_t pid;
   struct {
     bool present = false;
     uint8_t report_id;
     uint8_t report;
   } led;
-} hid[16];
+} hid[UHID_SLOTS];
+
+// what each usb keyboard last reported, to diff its next report against,
+// indexed like hid[] plus one for keyboards without a slot. core 1 only.
+struct {
+  uint8_t modifiers;
+  uint8_t keys[6];
+} usbkLast[UHID_SLOTS + 1];
+
+// views that inject keys see the modifiers held on any usb keyboard.
+static void usbkMergeModifiers() {
+  state.lastModifiers = 0;
+  for (const auto &last : usbkLast)
+    state.lastModifiers |= last.modifiers;
+}
 
 std::atomic<bool> waiting = true;
 
@@ -54,8 +86,12 @@ Pinout pinout;
 State state;
 Buzzer buzzer;
 Settings settings;
+Macro macro;
 USB3SUN_MUTEX usb3sun_mutex buzzerMutex;
+USB3SUN_MUTEX usb3sun_mutex hidMutex;
+USB3SUN_MUTEX usb3sun_mutex macroMutex;
 USB3SUN_MUTEX usb3sun_mutex settingsMutex;
+USB3SUN_MUTEX usb3sun_mutex sunkMutex;
 
 void drawStatus(int16_t x, int16_t y, const char *label, bool on);
 
@@ -87,15 +123,13 @@ struct DefaultView : View {
   }
 
   void handleKey(const UsbkChanges &changes) override {
-#ifdef DEBUG_TIMINGS
     unsigned long t = usb3sun_micros();
-#endif
 
 #ifdef SUNK_ENABLE
     for (size_t i = 0; i < changes.dvLen; i++) {
       // for DV bindings, make when key makes and break when key breaks
-      if (uint8_t sunkMake = USBK_TO_SUNK.dv[changes.dv[i].usbkModifier])
-        sunkSend(changes.dv[i].make, sunkMake);
+      if (uint8_t sunkMake = (*activeUsbkToSunk)[changes.dv[i].usbkModifier].dv)
+        sunkSend(changes.source, changes.dv[i].make, sunkMake);
     }
 #endif
 
@@ -120,13 +154,13 @@ struct DefaultView : View {
       // • make when the Sel key makes and the DV keys include CtrlR
       // • break when the Sel key breaks, even if the DV keys no longer include CtrlR
       // • do not make when CtrlR makes after the Sel key makes
-      if (uint8_t sunkMake = USBK_TO_SUNK.special[usbkSelector]) {
+      if (uint8_t sunkMake = (*activeUsbkToSunk)[usbkSelector].special) {
         if (make && !!(state.lastModifiers & USBK_CTRL_R)) {
-          sunkSend(true, sunkMake);
+          sunkSend(changes.source, true, sunkMake);
           specialBindingIsPressed[usbkSelector] = true;
           consumedBySpecialBinding[usbkSelector] = true;
         } else if (!make && specialBindingIsPressed[usbkSelector]) {
-          sunkSend(false, sunkMake);
+          sunkSend(changes.source, false, sunkMake);
           specialBindingIsPressed[usbkSelector] = false;
           consumedBySpecialBinding[usbkSelector] = true;
         }
@@ -135,20 +169,22 @@ struct DefaultView : View {
       // for Sel bindings
       // • make when key makes and break when key breaks
       // • do not make or break when key was consumed by the corresponding special binding
-      if (uint8_t sunkMake = USBK_TO_SUNK.sel[usbkSelector])
+      if (uint8_t sunkMake = (*activeUsbkToSunk)[usbkSelector].sel)
         if (!consumedBySpecialBinding[usbkSelector])
-          sunkSend(make, sunkMake);
+          sunkSend(changes.source, make, sunkMake);
     }
 
-#ifdef DEBUG_TIMINGS
-    Sprintf("sent in %ju\n", usb3sun_micros() - t);
-#endif
+    if (settings.logging(LOG_TIMINGS))
+      Sprintf("sent in %ju\n", usb3sun_micros() - t);
   }
 };
 
 static DefaultView DEFAULT_VIEW{};
 
 void setup() {
+  // before anything that might trace, and before anything that might panic.
+  traceBegin();
+
   // pico led on, then configure pin modes
   pinout.begin();
   Sprintln("usb3sun " USB3SUN_VERSION);
@@ -157,6 +193,7 @@ void setup() {
   usb3sun_display_init();
   Settings::begin();
   settings.readAll();
+  remapRebuild();
   pinout.beginSun();
 
   View::push(&DEFAULT_VIEW);
@@ -170,6 +207,7 @@ void setup() {
   waiting = false;
 
   usb3sun_gpio_write(LED_PIN, false);
+  pinout.debugFlush();
 }
 
 void drawStatus(int16_t x, int16_t y, const char *label, bool on) {
@@ -191,11 +229,18 @@ void loop() {
 #endif
 
   int input;
-  while ((input = usb3sun_debug_uart_read()) != -1) {
-    handleCliInput(input);
-  }
-
-  usb3sun_sleep_micros(10'000);
+  while (cliReadyForInput(CliPort::UART) && (input = usb3sun_debug_uart_read()) != -1)
+    handleCliInput(CliPort::UART, input);
+  while (cliReadyForInput(CliPort::CDC) && (input = usb3sun_debug_cdc_read()) != -1)
+    handleCliInput(CliPort::CDC, input);
+  cliUpdate();
+  while ((input = usb3sun_control_read()) != -1)
+    controlSocket.input(input);
+
+  // idle time on core 0 is when we write out any debug output.
+  pinout.debugFlush();
+
+  usb3sun_idle_micros(10'000);
 }
 
 #ifdef SUNK_ENABLE
@@ -203,6 +248,8 @@ void sunkEvent() {
   int result;
   while ((result = usb3sun_sunk_read()) != -1) {
     uint8_t command = result;
+    statsCount(Stat::SUNK_RX);
+    trace(TraceEvent::SUNK_RX, &command, sizeof command);
     Sprintf("sunk: rx %02Xh\n", command);
     switch (command) {
       case SUNK_RESET: {
@@ -210,6 +257,8 @@ void sunkEvent() {
         // usb3sun_sunk_write(0x7E);
         // usb3sun_sunk_write(0x01);
         uint8_t response[]{SUNK_RESET_RESPONSE, 0x04, 0x7F}; // TODO optional make code
+        trace(TraceEvent::SUNK_TX, response, sizeof response);
+        statsCount(Stat::SUNK_TX, sizeof response);
         usb3sun_sunk_write(response, sizeof response);
       } break;
       case SUNK_BELL_ON:
@@ -229,6 +278,8 @@ void sunkEvent() {
       case SUNK_LED: {
         while ((result = usb3sun_sunk_read()) == -1) usb3sun_sleep_micros(1'000);
         uint8_t status = result;
+        statsCount(Stat::SUNK_RX);
+        trace(TraceEvent::SUNK_RX, &status, sizeof status);
         Sprintf("sunk: led status %02Xh\n", status);
         state.num = status & 1 << 0;
         state.compose = status & 1 << 1;
@@ -240,8 +291,9 @@ void sunkEvent() {
         usb3sun_fifo_push((uint32_t)Message::UHID_LED_FROM_STATE);
       } break;
       case SUNK_LAYOUT: {
-        // UNITED STATES (TODO alternate layouts)
-        uint8_t response[]{SUNK_LAYOUT_RESPONSE, 0b00000000};
+        uint8_t response[]{SUNK_LAYOUT_RESPONSE, sunkLayout().code};
+        trace(TraceEvent::SUNK_TX, response, sizeof response);
+        statsCount(Stat::SUNK_TX, sizeof response);
         usb3sun_sunk_write(response, sizeof response);
       } break;
     }
@@ -298,12 +350,10 @@ void loop1() {
           break;
       }
 #if defined(UHID_LED_ENABLE)
-#ifndef UHID_VERBOSE
-      Sprint("*");
-#endif
-#ifdef UHID_VERBOSE
-      Sprintf("hid [%zu]: usb [%u:%u]: set led report %02Xh\n", i, dev_addr, instance, hid[i].led.report);
-#endif
+      if (settings.logging(LOG_UHID))
+        Sprintf("hid [%zu]: usb [%u:%u]: set led report %02Xh\n", i, dev_addr, instance, hid[i].led.report);
+      else if (settings.logging(LOG_PROGRESS))
+        Sprint("*");
       usb3sun_uhid_set_led_report(dev_addr, instance, report_id, hid[i].led.report);
 #else
       (void) dev_addr;
@@ -314,8 +364,34 @@ void loop1() {
   }
   usb3sun_usb_task();
   buzzer.update();
+  macro.update();
+  remapUpdate();
 }
 
+// a `log capture` line (see replay.h), built up then written in one go, so
+// it’s either logged whole or dropped whole, never cut short or interleaved.
+struct CaptureLine {
+  char text[320];
+  size_t len = 0;
+  bool overflow = false;
+
+  void append(const char *format, ...) __attribute__ ((format (printf, 2, 3))) {
+    va_list ap;
+    va_start(ap, format);
+    int n = vsnprintf(&text[len], sizeof text - len, format, ap);
+    va_end(ap);
+    if (n < 0 || static_cast<size_t>(n) >= sizeof text - len)
+      overflow = true;
+    else
+      len += n;
+  }
+  void write() {
+    append("\n");
+    if (overflow || !pinout.debugWrite(text, len))
+      statsCount(Stat::CAPTURE_DROPPED);
+  }
+};
+
 // Invoked when device with hid interface is mounted
 // Report descriptor is also available for use.
 // tuh_hid_parse_report_descriptor() can be used to parse common/simple enough
@@ -333,6 +409,14 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_re
 
   // hid_subclass_enum_t if_subclass = ...;
   uint8_t if_protocol = usb3sun_uhid_interface_protocol(dev_addr, instance);
+  if (settings.logging(LOG_CAPTURE)) {
+    // see replay.h for the format.
+    CaptureLine line{};
+    line.append("@hid mount %ju %u:%u %04x:%04x %u", usb3sun_micros(), dev_addr, instance, vid, pid, if_protocol);
+    for (size_t i = 0; i < reports_len; i++)
+      line.append(" %u/%02X/%04X", reports[i].report_id, reports[i].usage, reports[i].usage_page);
+    line.write();
+  }
   Sprintf("    bInterfaceProtocol=%u", if_protocol);
   switch (if_protocol) {
     case USB3SUN_UHID_KEYBOARD:
@@ -349,6 +433,7 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_re
   switch (if_protocol) {
     case USB3SUN_UHID_KEYBOARD:
     case USB3SUN_UHID_MOUSE: {
+      MutexGuard m{&hidMutex};
       bool ok = false;
       for (size_t i = 0; i < sizeof(hid) / sizeof(*hid); i++) {
         if (!hid[i].present) {
@@ -359,6 +444,8 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_re
           hid[i].dev_addr = dev_addr;
           hid[i].instance = instance;
           hid[i].if_protocol = if_protocol;
+          hid[i].vid = vid;
+          hid[i].pid = pid;
           hid[i].led.present = false;
           if (if_protocol == USB3SUN_UHID_KEYBOARD) {
             for (size_t j = 0; j < reports_len; j++) {
@@ -396,15 +483,52 @@ void tuh_mount_cb(uint8_t dev_addr) {
 
 void tuh_umount_cb(uint8_t dev_addr) {
   Sprintf("usb [%u]: unmount\n", dev_addr);
-  for (size_t i = 0; i < sizeof(hid) / sizeof(*hid); i++) {
-    if (hid[i].present && hid[i].dev_addr == dev_addr) {
-      Sprintf("hid [%zu]: removing\n", i);
-      hid[i].present = false;
+  if (settings.logging(LOG_CAPTURE)) {
+    CaptureLine line{};
+    line.append("@hid umount %ju %u", usb3sun_micros(), dev_addr);
+    line.write();
+  }
+  std::bitset<UHID_SLOTS> removed;
+  {
+    MutexGuard m{&hidMutex};
+    for (size_t i = 0; i < sizeof(hid) / sizeof(*hid); i++) {
+      if (hid[i].present && hid[i].dev_addr == dev_addr) {
+        Sprintf("hid [%zu]: removing\n", i);
+        hid[i].present = false;
+        removed[i] = true;
+      }
+    }
+  }
+  // release whatever a keyboard was holding when it went away, and don’t
+  // diff the next keyboard in its slot against it.
+  for (size_t i = 0; i < removed.size(); i++) {
+    if (removed[i]) {
+      usbkLast[i] = {};
+      sunkReleaseAll(usbKeySource(i));
     }
   }
+  usbkMergeModifiers();
   buzzer.unplug();
 }
 
+void uhidDump() {
+  MutexGuard m{&hidMutex};
+  size_t count = 0;
+  for (size_t i = 0; i < sizeof(hid) / sizeof(*hid); i++) {
+    if (!hid[i].present)
+      continue;
+    Sprintf("hid [%zu]: usb [%u:%u] %04x:%04x, %s",
+      i, hid[i].dev_addr, hid[i].instance, hid[i].vid, hid[i].pid,
+      hid[i].if_protocol == USB3SUN_UHID_KEYBOARD ? "boot keyboard" : "boot mouse");
+    if (hid[i].led.present)
+      Sprintf(", led report_id=%u", hid[i].led.report_id);
+    Sprintln();
+    count++;
+  }
+  if (count == 0)
+    Sprintln("hid: no devices");
+}
+
 void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_t protocol) {
   // haven’t seen this actually get printed so far, but only tried a few devices
   Sprintf("usb [%u:%u]: hid set protocol returned %u\n", dev_addr, instance, protocol);
@@ -413,40 +537,56 @@ void tuh_hid_set_protocol_complete_cb(uint8_t dev_addr, uint8_t instance, uint8_
 // Invoked when received report from device via interrupt endpoint
 void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len) {
   uint8_t if_protocol = usb3sun_uhid_interface_protocol(dev_addr, instance);
-#ifdef UHID_VERBOSE
-  Sprintf("usb [%u:%u]: hid report if_protocol=%u", dev_addr, instance, if_protocol);
-  for (uint16_t i = 0; i < len; i++)
-    Sprintf(" %02Xh", report[i]);
-#else
-  Sprint(".");
-  (void) len;
-#endif
+  LatencyScope latency{if_protocol == USB3SUN_UHID_MOUSE ? LatencyPath::MOUSE : LatencyPath::KEYBOARD};
+  trace(TraceEvent::HID_REPORT, dev_addr, instance, report, len);
+  if (settings.logging(LOG_CAPTURE)) {
+    CaptureLine line{};
+    line.append("@hid report %ju %u:%u", usb3sun_micros(), dev_addr, instance);
+    for (uint16_t i = 0; i < len; i++)
+      line.append(" %02X", report[i]);
+    line.write();
+  }
+  const bool verbose = settings.logging(LOG_UHID);
+  if (verbose) {
+    Sprintf("usb [%u:%u]: hid report if_protocol=%u", dev_addr, instance, if_protocol);
+    for (uint16_t i = 0; i < len; i++)
+      Sprintf(" %02Xh", report[i]);
+  } else if (settings.logging(LOG_PROGRESS)) {
+    Sprint(".");
+  }
 
   switch (if_protocol) {
     case USB3SUN_UHID_KEYBOARD: {
-      const UsbkReport *kreport = reinterpret_cast<const UsbkReport *>(report);
+      statsCount(Stat::UHID_KEYBOARD_REPORT);
+      // zero-pad short reports, rather than reading past the end.
+      UsbkReport kreportCopy{};
+      memcpy(&kreportCopy, report, std::min(static_cast<size_t>(len), sizeof kreportCopy));
+      const UsbkReport *kreport = &kreportCopy;
 
-#ifdef DEBUG_TIMINGS
       unsigned long t = usb3sun_micros();
-#endif
 
       for (int i = 0; i < 6; i++) {
         if (kreport->keycode[i] != USBK_RESERVED && kreport->keycode[i] < USBK_FIRST_KEYCODE) {
-#ifdef UHID_VERBOSE
-          Sprintf(" !%u\n", kreport->keycode[i]);
-#endif
+          if (verbose)
+            Sprintf(" !%u\n", kreport->keycode[i]);
           goto out;
         }
       }
 
+      size_t slot = UHID_SLOTS;
+      for (size_t i = 0; i < UHID_SLOTS; i++)
+        if (hid[i].present && hid[i].dev_addr == dev_addr && hid[i].instance == instance)
+          slot = i;
+      auto &last = usbkLast[slot];
+
       UsbkChanges changes{};
       changes.kreport = *kreport;
+      changes.source = usbKeySource(slot);
 
       for (int i = 0; i < 8; i++) {
-        if ((state.lastModifiers & 1 << i) != (kreport->modifier & 1 << i)) {
-#ifdef UHID_VERBOSE
-          Sprintf(" %c%s", kreport->modifier & 1 << i ? '+' : '-', MODIFIER_NAMES[i]);
-#endif
+        if ((last.modifiers & 1 << i) != (kreport->modifier & 1 << i)) {
+          if (verbose)
+            Sprintf(" %c%s", kreport->modifier & 1 << i ? '+' : '-', MODIFIER_NAMES[i]);
           changes.dv[changes.dvLen++] = {(uint8_t) (1u << i), kreport->modifier & 1 << i ? true : false};
         }
       }
@@ -455,51 +595,48 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
         bool oldInNews = false;
         bool newInOlds = false;
         for (int j = 0; j < 6; j++) {
-          if (state.lastKeys[i] == kreport->keycode[j])
+          if (last.keys[i] == kreport->keycode[j])
             oldInNews = true;
-          if (kreport->keycode[i] == state.lastKeys[j])
+          if (kreport->keycode[i] == last.keys[j])
             newInOlds = true;
         }
-        if (!oldInNews && state.lastKeys[i] >= USBK_FIRST_KEYCODE) {
-#ifdef UHID_VERBOSE
-          Sprintf(" -%u", state.lastKeys[i]);
-#endif
-          changes.sel[changes.selLen++] = {state.lastKeys[i], false};
+        if (!oldInNews && last.keys[i] >= USBK_FIRST_KEYCODE) {
+          if (verbose)
+            Sprintf(" -%u", last.keys[i]);
+          changes.sel[changes.selLen++] = {last.keys[i], false};
         }
         if (!newInOlds && kreport->keycode[i] >= USBK_FIRST_KEYCODE) {
-#ifdef UHID_VERBOSE
-          Sprintf(" +%u", kreport->keycode[i]);
-#endif
+          if (verbose)
+            Sprintf(" +%u", kreport->keycode[i]);
           changes.sel[changes.selLen++] = {kreport->keycode[i], true};
         }
       }
 
-#ifdef UHID_VERBOSE
-      Sprintln();
-#endif
-#ifdef DEBUG_TIMINGS
-      Sprintf("diffed in %ju\n", usb3sun_micros() - t);
-#endif
+      if (verbose)
+        Sprintln();
+      if (settings.logging(LOG_TIMINGS))
+        Sprintf("diffed in %ju\n", usb3sun_micros() - t);
 
       View::sendKeys(changes);
 
       // commit the DV and Sel changes
-      state.lastModifiers = changes.kreport.modifier;
+      last.modifiers = changes.kreport.modifier;
       for (int i = 0; i < 6; i++)
-        state.lastKeys[i] = changes.kreport.keycode[i];
+        last.keys[i] = changes.kreport.keycode[i];
+      usbkMergeModifiers();
     } break;
     case USB3SUN_UHID_MOUSE: {
-      const UsbmReport *mreport = reinterpret_cast<const UsbmReport *>(report);
-#ifdef UHID_VERBOSE
-      Sprintf(" buttons=%u x=%d y=%d", mreport->buttons, mreport->x, mreport->y);
-#endif
-
-#ifdef UHID_VERBOSE
-      for (int i = 0; i < 3; i++)
-        if ((state.lastButtons & 1 << i) != (mreport->buttons & 1 << i))
-          Sprintf(" %c%s", mreport->buttons & 1 << i ? '+' : '-', BUTTON_NAMES[i]);
-      Sprintln();
-#endif
+      statsCount(Stat::UHID_MOUSE_REPORT);
+      UsbmReport mreportCopy{};
+      memcpy(&mreportCopy, report, std::min(static_cast<size_t>(len), sizeof mreportCopy));
+      const UsbmReport *mreport = &mreportCopy;
+      if (verbose) {
+        Sprintf(" buttons=%u x=%d y=%d", mreport->buttons, mreport->x, mreport->y);
+        for (int i = 0; i < 3; i++)
+          if ((state.lastButtons & 1 << i) != (mreport->buttons & 1 << i))
+            Sprintf(" %c%s", mreport->buttons & 1 << i ? '+' : '-', BUTTON_NAMES[i]);
+        Sprintln();
+      }
 
       sunmSend(
         mreport->x, mreport->y,
@@ -510,9 +647,8 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
       state.lastButtons = mreport->buttons;
     } break;
     default: {
-#ifdef UHID_VERBOSE
-      Sprintln();
-#endif
+      if (verbose)
+        Sprintln();
     } break;
   }
 out:
@@ -521,12 +657,18 @@ out:
     Sprintf("error: usb [%u:%u]: failed to request to receive report\n", dev_addr, instance);
 }
 
-#ifdef USB3SUN_HAL_LINUX_NATIVE
+// tests, demo, and main (fuzz and bench builds have their own main).
+#if defined(USB3SUN_HAL_LINUX_NATIVE) && !defined(USB3SUN_FUZZ) && !defined(USB3SUN_BENCH)
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -534,7 +676,7 @@ out:
 #define TEST_REQUIRES(expr) do { fprintf(stderr, ">>> skipping test (%s)\n", #expr); return true; } while (0)
 #define TEST_ASSERT_EQ(actual, expected) do { if (actual != expected) { std::cerr << "\n" __FILE__ ":" << __LINE__ << ": assertion failed: " #actual "\n    actual: " << actual << "\n    expected: " << expected << "\n"; return false; } } while (0)
 static bool assert_then_clear_test_history(const char *file, size_t line, const std::vector<Op> &expected) {
-  const std::vector<Entry> &actual = usb3sun_test_get_history();
+  const History &actual = usb3sun_test_get_history();
   std::optional<size_t> first_difference{};
   for (size_t i = 0; i < actual.size() || i < expected.size(); i++) {
     if ((i < actual.size()) != (i < expected.size()) || actual[i].op != expected[i]) {
@@ -568,6 +710,7 @@ static std::vector<const char *> test_names = {
   "setup_pinout_v2",
   "sunk_reset",
   "uhid_mount",
+  "uhid_two_keyboards",
   "buzzer_bell",
   "buzzer_click",
   "settings_read_ok",
@@ -578,10 +721,32 @@ static std::vector<const char *> test_names = {
   "view_stack",
   "menu_settings",
   "menu_hostid",
+  "latency",
+  "cli_esc_timeout",
+  "cli_commands",
+  "cli_paste",
+  "cli_ports",
+  "control_protocol",
+  "debug_binary",
+  "history",
+  "replay",
+  "fifo",
+  "uart_model",
+  "macro",
+  "keyboard_layout",
+  "remap",
+  "remap_held",
+  "sunk_merge",
 };
 
 static void help() {
-  std::cerr << "usage: path/to/program <demo|all|test_name>\n";
+  std::cerr << "usage: path/to/program <demo|test_name>\n";
+  std::cerr << "       path/to/program demo [--threads] [--pty] [--pace] [--control path/to/socket] [path/to/display]\n";
+  std::cerr << "       path/to/program <test_name> --history path/to/history.txt\n";
+  std::cerr << "       path/to/program all [-j jobs] [--json path/to/summary.json]\n";
+  std::cerr << "       path/to/program decode <firmware.elf> [log]\n";
+  std::cerr << "       path/to/program replay <capture|-> [--speed factor] [-o path/to/output.txt]\n";
+  std::cerr << "       path/to/program control <socket|tty> <command> [args]\n";
   std::cerr << "...where test_name can be one of:\n";
   for (const char *&name : test_names) {
     std::cerr << "    " << name << "\n";
@@ -596,7 +761,28 @@ static std::vector<uint8_t> bytes(size_t len, const char *data) {
   return bytes(len, reinterpret_cast<const uint8_t *>(data));
 }
 
+#ifdef SUNK_ENABLE
+// the sun keyboard bytes for a macro that types the given text.
+static void append_typed(std::vector<Op> &ops, const char *text) {
+  auto push = [&ops](uint8_t code) { ops.push_back(SunkWriteOp {bytes(1, &code)}); };
+  for (; *text != '\0'; text++) {
+    uint16_t sunk = ASCII_TO_SUNK[static_cast<uint8_t>(*text)];
+    uint8_t code = sunk & 0xFF;
+    if (!!(sunk & SUNK_SEND_SHIFT))
+      push(SUNK_SHIFT_L);
+    push(code);
+    push(code | SUNK_BREAK_BIT);
+    if (!!(sunk & SUNK_SEND_SHIFT))
+      push(SUNK_SHIFT_L | SUNK_BREAK_BIT);
+    push(SUNK_IDLE);
+  }
+}
+#endif
+
 static bool run_test(const char *test_name) {
+  // tests never need to wait in real time, and they should be deterministic.
+  usb3sun_test_virtual_clock(true);
+
   if (!strcmp(test_name, "setup_pinout_v1")) {
     usb3sun_test_init(PinoutV2Op::id | SunkInitOp::id | SunmInitOp::id | GpioWriteOp::id | GpioReadOp::id);
     usb3sun_mock_gpio_read(PINOUT_V2_PIN, false);
@@ -653,6 +839,168 @@ static bool run_test(const char *test_name) {
     });
   }
 
+  if (!strcmp(test_name, "keyboard_layout")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#endif
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    settings.keyboardLayout = KeyboardLayoutV2::Value {KeyboardLayout::_::DE};
+    remapRebuild();
+
+    // the host asks for the layout to choose its keymap.
+    usb3sun_mock_sunk_read("\x0F", 1); // SUNK_LAYOUT
+    while (usb3sun_mock_sunk_read_has_input())
+      serialEvent1();
+
+    // the iso key left of Z has its own sun keycode.
+    View::sendMakeBreak({}, 100);
+
+    // macros type y and - where the german keymap has them.
+    sunkSend("%s", "y-");
+    while (macro.busy())
+      loop1();
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      SunkWriteOp {{0xFE, 0x05}},
+      SunkWriteOp {{0x7C}},
+      SunkWriteOp {{0xFC}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x64}},
+      SunkWriteOp {{0xE4}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x6D}},
+      SunkWriteOp {{0xED}},
+      SunkWriteOp {{0x7F}},
+    });
+  }
+
+  if (!strcmp(test_name, "remap")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#endif
+    usb3sun_test_init(SunkWriteOp::id | FsWriteOp::id);
+    setup();
+
+    auto remapBytes = [](std::vector<uint8_t> entries) {
+      entries.resize(sizeof (RemapV2::Value));
+      return entries;
+    };
+
+    // caps lock → control, left gui → compose, backspace → nothing.
+    for (const char *c = "bind 39 4c\rbind e3 43\rbind 2a off\r"; *c; c++)
+      handleCliInput(CliPort::UART, *c);
+    TEST_ASSERT_EQ(settings.remap.entries[0].usbk, 0x39);
+    TEST_ASSERT_EQ(settings.remap.entries[0].sunkMake, 0x4C);
+    TEST_ASSERT_EQ(settings.remap.entries[2].usbk, 0x2A);
+    TEST_ASSERT_EQ(settings.remap.entries[2].sunkMake, 0x00);
+
+    // the cli runs on core 0, so nothing changes until core 1 merges them.
+    View::sendMakeBreak({}, 0x39);
+    loop1();
+    View::sendMakeBreak({}, 0x39);
+    View::sendMakeBreak(USBK_GUI_L, 0);
+    View::sendMakeBreak({}, 0x2A);
+
+    // back to the layout’s bindings.
+    for (const char *c = "bind 39 default\rbind reset\r"; *c; c++)
+      handleCliInput(CliPort::UART, *c);
+    loop1();
+    View::sendMakeBreak({}, 0x39);
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      FsWriteOp {"/remap.v2", remapBytes({0x39, 0x4C})},
+      FsWriteOp {"/remap.v2", remapBytes({0x39, 0x4C, 0xE3, 0x43})},
+      FsWriteOp {"/remap.v2", remapBytes({0x39, 0x4C, 0xE3, 0x43, 0x2A, 0x00})},
+      SunkWriteOp {{0x77}},
+      SunkWriteOp {{0xF7}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x4C}},
+      SunkWriteOp {{0xCC}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x43}},
+      SunkWriteOp {{0xC3}},
+      SunkWriteOp {{0x7F}},
+      FsWriteOp {"/remap.v2", remapBytes({0x00, 0x00, 0xE3, 0x43, 0x2A, 0x00})},
+      FsWriteOp {"/remap.v2", remapBytes({})},
+      SunkWriteOp {{0x77}},
+      SunkWriteOp {{0xF7}},
+      SunkWriteOp {{0x7F}},
+    });
+  }
+
+  if (!strcmp(test_name, "remap_held")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#endif
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    UsbkChanges aMake{{0, {}, {USBK_A}}, {}, {{USBK_A, true}}, 0, 1};
+    UsbkChanges aBreak{{0, {}, {}}, {}, {{USBK_A, false}}, 0, 1};
+
+    // a key held while its binding changes is released, rather than
+    // waiting for a break that would be looked up in the new table.
+    View::sendKeys(aMake);
+    for (const char *c = "bind 04 4c\r"; *c; c++)
+      handleCliInput(CliPort::UART, *c);
+    loop1();
+    View::sendKeys(aBreak);
+
+    // and the next press uses the new binding.
+    View::sendKeys(aMake);
+    View::sendKeys(aBreak);
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      SunkWriteOp {{0x4D}}, // A
+      SunkWriteOp {{0xCD}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x4C}},
+      SunkWriteOp {{0xCC}},
+      SunkWriteOp {{0x7F}},
+    });
+  }
+
+  if (!strcmp(test_name, "sunk_merge")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#endif
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    UsbkChanges shiftMake{{USBK_SHIFT_L, {}, {}}, {{USBK_SHIFT_L, true}}, {}, 1, 0};
+    UsbkChanges shiftBreak{{0, {}, {}}, {{USBK_SHIFT_L, false}}, {}, 1, 0};
+    UsbkChanges aMake{{0, {}, {USBK_A}}, {}, {{USBK_A, true}}, 0, 1};
+    UsbkChanges aBreak{{0, {}, {}}, {}, {{USBK_A, false}}, 0, 1};
+
+    // a macro typing “A” while shift is held on a usb keyboard must not
+    // release shift out from under the user.
+    View::sendKeys(shiftMake);
+    sunkSend("A");
+    while (macro.busy())
+      loop1();
+    View::sendKeys(shiftBreak);
+
+    // a key held on a usb keyboard stays held until it’s released there,
+    // even if something else presses and releases it in the meantime.
+    View::sendKeys(aMake);
+    View::sendMakeBreak({}, USBK_A);
+    View::sendKeys(aBreak);
+
+    // stray breaks are dropped.
+    View::sendKeys(aBreak);
+    sunkSend(KeySource::MACRO, false, SUNK_SHIFT_L);
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      SunkWriteOp {{0x63}}, // ShiftL
+      SunkWriteOp {{0x4D}}, // A
+      SunkWriteOp {{0xCD}},
+      SunkWriteOp {{0xE3}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x4D}},
+      SunkWriteOp {{0xCD}},
+      SunkWriteOp {{0x7F}},
+    });
+  }
+
   if (!strcmp(test_name, "uhid_mount")) {
     usb3sun_test_init(UhidRequestReportOp::id);
     setup();
@@ -680,6 +1028,43 @@ static bool run_test(const char *test_name) {
     });
   }
 
+  if (!strcmp(test_name, "uhid_two_keyboards")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#endif
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+
+    uint8_t empty[]{};
+    usb3sun_mock_uhid_parse_report_descriptor(std::vector<usb3sun_hid_report_info> {});
+    usb3sun_mock_uhid_interface_protocol(USB3SUN_UHID_KEYBOARD);
+    usb3sun_mock_uhid_request_report_result(true);
+    tuh_hid_mount_cb(1, 0, empty, 0);
+    tuh_hid_mount_cb(2, 0, empty, 0);
+
+    // shift stays held until both keyboards release it.
+    const uint8_t shift[8]{USBK_SHIFT_L};
+    const uint8_t a[8]{0, 0, USBK_A};
+    const uint8_t none[8]{};
+    tuh_hid_report_received_cb(1, 0, shift, sizeof shift);
+    tuh_hid_report_received_cb(2, 0, shift, sizeof shift);
+    tuh_hid_report_received_cb(1, 0, none, sizeof none);
+    tuh_hid_report_received_cb(2, 0, none, sizeof none);
+
+    // unplugging a keyboard releases what it was holding.
+    tuh_hid_report_received_cb(1, 0, a, sizeof a);
+    tuh_umount_cb(1);
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      SunkWriteOp {{0x63}}, // ShiftL
+      SunkWriteOp {{0xE3}},
+      SunkWriteOp {{0x7F}},
+      SunkWriteOp {{0x4D}}, // A
+      SunkWriteOp {{0xCD}},
+      SunkWriteOp {{0x7F}},
+    });
+  }
+
   if (!strcmp(test_name, "buzzer_bell")) {
 #ifndef SUNK_ENABLE
     TEST_REQUIRES(SUNK_ENABLE);
@@ -712,14 +1097,12 @@ static bool run_test(const char *test_name) {
       }
     };
     const auto pressKey = []() {
-      sunkSend(true, SUNK_RETURN);
-      sunkSend(false, SUNK_RETURN);
+      sunkSend(KeySource::INJECTED, true, SUNK_RETURN);
+      sunkSend(KeySource::INJECTED, false, SUNK_RETURN);
     };
     const auto pumpBuzzerUpdates = []() {
-      uint64_t t_start = usb3sun_micros();
-      while (usb3sun_micros() - t_start < 5'000) {
-        loop1();
-      }
+      loop1();
+      usb3sun_test_advance_micros(settings.clickDuration * 1'000);
       loop1();
     };
     usb3sun_test_init(BuzzerStartOp::id | GpioWriteOp::id);
@@ -801,6 +1184,14 @@ static bool run_test(const char *test_name) {
         memcpy(data, "\x31\x32\x33\x34\x35\x36", actual_len = std::min(data_len, (size_t)6));
         return true;
       }
+      if (!strcmp(path, "/keyboardLayout.v2")) {
+        memcpy(data, "\x02\x00\x00\x00", actual_len = std::min(data_len, (size_t)4));
+        return true;
+      }
+      if (!strcmp(path, "/logCategories.v2")) {
+        memcpy(data, "\x06\x00\x00\x00", actual_len = std::min(data_len, (size_t)4));
+        return true;
+      }
       return false;
     });
     setup();
@@ -808,11 +1199,16 @@ static bool run_test(const char *test_name) {
     TEST_ASSERT_EQ(settings.forceClick.current, ForceClick::_::ON);
     TEST_ASSERT_EQ(settings.mouseBaud.current, MouseBaud::_::S4800);
     TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'1', '2', '3', '4', '5', '6'}}));
+    TEST_ASSERT_EQ(settings.keyboardLayout.current, KeyboardLayout::_::DE);
+    TEST_ASSERT_EQ(settings.logCategories, (LOG_SUNK | LOG_SUNM));
     return assert_then_clear_test_history(std::vector<Op> {
       FsReadOp {"/clickDuration.v2", 8, bytes(8, "\x55\x55\x55\x55\x55\x55\x55\x55")},
       FsReadOp {"/forceClick.v2", 4, bytes(4, "\x02\x00\x00\x00")},
       FsReadOp {"/mouseBaud.v2", 4, bytes(4, "\x02\x00\x00\x00")},
       FsReadOp {"/hostid.v2", 6, bytes(6, "\x31\x32\x33\x34\x35\x36")},
+      FsReadOp {"/keyboardLayout.v2", 4, bytes(4, "\x02\x00\x00\x00")},
+      FsReadOp {"/remap.v2", 32, {}},
+      FsReadOp {"/logCategories.v2", 4, bytes(4, "\x06\x00\x00\x00")},
     });
   }
 
@@ -839,6 +1235,9 @@ static bool run_test(const char *test_name) {
       FsReadOp {"/mouseBaud", 8, {}},
       FsReadOp {"/hostid.v2", 6, {}},
       FsReadOp {"/hostid", 12, {}},
+      FsReadOp {"/keyboardLayout.v2", 4, {}},
+      FsReadOp {"/remap.v2", 32, {}},
+      FsReadOp {"/logCategories.v2", 4, {}},
     });
   }
 
@@ -885,6 +1284,9 @@ static bool run_test(const char *test_name) {
       FsReadOp {"/hostid.v2", 6, {}},
       FsReadOp {"/hostid", 12, bytes(12, "\x01\x00\x00\x00\x31\x32\x33\x34\x35\x36\xAA\xAA")},
       FsWriteOp {"/hostid.v2", bytes(6, "\x31\x32\x33\x34\x35\x36")},
+      FsReadOp {"/keyboardLayout.v2", 4, {}},
+      FsReadOp {"/remap.v2", 32, {}},
+      FsReadOp {"/logCategories.v2", 4, {}},
     });
   }
 
@@ -927,6 +1329,9 @@ static bool run_test(const char *test_name) {
       FsReadOp {"/mouseBaud", 8, bytes(8, "\x00\x00\x00\x00\x02\x00\x00\x00")},
       FsReadOp {"/hostid.v2", 6, {}},
       FsReadOp {"/hostid", 12, bytes(12, "\x00\x00\x00\x00\x31\x32\x33\x34\x35\x36\xAA\xAA")},
+      FsReadOp {"/keyboardLayout.v2", 4, {}},
+      FsReadOp {"/remap.v2", 32, {}},
+      FsReadOp {"/logCategories.v2", 4, {}},
     });
   }
 
@@ -969,6 +1374,9 @@ static bool run_test(const char *test_name) {
       FsReadOp {"/mouseBaud", 8, bytes(7, "\x01\x00\x00\x00\x02\x00\x00")},
       FsReadOp {"/hostid.v2", 6, {}},
       FsReadOp {"/hostid", 12, bytes(11, "\x01\x00\x00\x00\x31\x32\x33\x34\x35\x36\xAA")},
+      FsReadOp {"/keyboardLayout.v2", 4, {}},
+      FsReadOp {"/remap.v2", 32, {}},
+      FsReadOp {"/logCategories.v2", 4, {}},
     });
   }
 
@@ -983,6 +1391,605 @@ static bool run_test(const char *test_name) {
     return true;
   }
 
+  if (!strcmp(test_name, "history")) {
+    usb3sun_test_init(SunkWriteOp::id | SunmWriteOp::id | GpioWriteOp::id | FsWriteOp::id);
+    uint8_t data[]{0x01, 0x02, 0x03};
+    usb3sun_sunk_write(data, sizeof data);
+    usb3sun_gpio_write(PINOUT_V2_PIN, true);
+    usb3sun_buzzer_start(1000); // filtered out
+    usb3sun_fs_write("/path", reinterpret_cast<const char *>(data), 2);
+    usb3sun_sunm_write(data, 1);
+
+    // filtered iteration only decodes the entries it yields.
+    const History &history = usb3sun_test_get_history();
+    std::vector<Op> writes{};
+    for (const Entry &entry : history.filter(SunkWriteOp::id | SunmWriteOp::id))
+      writes.push_back(entry.op);
+    TEST_ASSERT_EQ(writes.size(), 2u);
+    TEST_ASSERT_EQ(writes[0], Op {SunkWriteOp {bytes(3, "\x01\x02\x03")}});
+    TEST_ASSERT_EQ(writes[1], Op {SunmWriteOp {bytes(1, "\x01")}});
+
+    std::ostringstream output{};
+    output << history[2].op;
+    TEST_ASSERT_EQ(output.str(), "fs_write /path <01 02>");
+
+    return assert_then_clear_test_history(std::vector<Op> {
+      SunkWriteOp {bytes(3, "\x01\x02\x03")},
+      GpioWriteOp {PINOUT_V2_PIN, true},
+      FsWriteOp {"/path", bytes(2, "\x01\x02")},
+      SunmWriteOp {bytes(1, "\x01")},
+    });
+  }
+
+  if (!strcmp(test_name, "replay")) {
+    // a keyboard and a mouse, typing A then clicking, among other output.
+    char capture[] =
+      "usb [1]: mount\n"
+      "@hid mount 5000000 1:0 046d:c31c 1 1/06/0001\n"
+      "@hid mount 5001000 2:0 046d:c077 2\n"
+      "@hid report 6000000 1:0 00 00 04 00 00 00 00 00\n"
+      "@hid report 6050000 1:0 00 00 05\n" // rejected, because cut short
+      "@hid report 6100000 1:0 00 00 00 00 00 00 00 00\n"
+      "@hid report 7000000 2:0 01 05 FB\n"
+      "@hid report 7050000 2:0 01 05\n" // rejected, because the first was longer
+      "@hid umount 8000000 2\n"
+      "@hid report 8000001 2:0 00 00 00\n"; // ignored, because unmounted
+    FILE *input = fmemopen(capture, strlen(capture), "r");
+    std::ostringstream output{};
+    if (replayCapture(input, 0, output) != 0) return false;
+    fclose(input);
+
+    std::vector<Op> expected{};
+#ifdef SUNK_ENABLE
+    expected.push_back(SunkWriteOp {bytes(1, "\x4D")});
+    expected.push_back(SunkWriteOp {bytes(1, "\xCD")});
+    expected.push_back(SunkWriteOp {bytes(1, "\x7F")});
+#endif
+#ifdef SUNM_ENABLE
+    expected.push_back(SunmWriteOp {bytes(5, "\x83\x05\x05\x00\x00")});
+#endif
+    return assert_then_clear_test_history(expected);
+  }
+
+  if (!strcmp(test_name, "fifo")) {
+    usb3sun_test_init(0);
+    static usb3sun_mutex mutex{};
+    static size_t counter = 0;
+    static std::atomic<size_t> core1Id = 0;
+    const size_t increments = 100'000;
+
+    // core 0 can fill the fifo into core 1, but can’t read its own writes.
+    for (uint32_t i = 0; i < 8; i++)
+      TEST_ASSERT_EQ(usb3sun_fifo_push(i), true);
+    TEST_ASSERT_EQ(usb3sun_fifo_push(8), false);
+    uint32_t value;
+    TEST_ASSERT_EQ(usb3sun_fifo_pop(&value), false);
+
+    // core 1 reads them in order and replies on the other fifo, while both
+    // cores race to increment the counter.
+    std::thread core1 = usb3sun_test_start_core1([] {
+      core1Id = usb3sun_core_id();
+      uint32_t value;
+      while (usb3sun_fifo_pop(&value))
+        usb3sun_fifo_push(value * 2);
+      for (size_t i = 0; i < increments; i++) {
+        MutexGuard m{&mutex};
+        counter++;
+      }
+    });
+    for (size_t i = 0; i < increments; i++) {
+      MutexGuard m{&mutex};
+      counter++;
+    }
+    core1.join();
+    TEST_ASSERT_EQ(core1Id, 1u);
+    TEST_ASSERT_EQ(usb3sun_core_id(), 0u);
+    TEST_ASSERT_EQ(counter, 2 * increments);
+    for (uint32_t i = 0; i < 8; i++) {
+      TEST_ASSERT_EQ(usb3sun_fifo_pop(&value), true);
+      TEST_ASSERT_EQ(value, i * 2);
+    }
+    TEST_ASSERT_EQ(usb3sun_fifo_pop(&value), false);
+    return true;
+  }
+
+  if (!strcmp(test_name, "uart_model")) {
+    usb3sun_test_init(0);
+    usb3sun_test_uart_model(true);
+    const uint64_t byteMicros = 8'333; // 1200 baud
+    TEST_ASSERT_EQ(usb3sun_sunk_available_for_write(), 32u);
+
+    // the first 32 bytes fill the fifo, then each byte waits for one to drain.
+    uint8_t data[40]{};
+    auto t = usb3sun_micros();
+    TEST_ASSERT_EQ(usb3sun_sunk_write(data, sizeof data), sizeof data);
+    TEST_ASSERT_EQ(usb3sun_micros() - t, 8 * byteMicros);
+    TEST_ASSERT_EQ(usb3sun_sunk_available_for_write(), 0u);
+    usb3sun_test_advance_micros(byteMicros);
+    TEST_ASSERT_EQ(usb3sun_sunk_available_for_write(), 1u);
+
+    const UartStats &stats = usb3sun_test_sunk_stats();
+    TEST_ASSERT_EQ(stats.bytes, 40u);
+    TEST_ASSERT_EQ(stats.stalls, 8u);
+    TEST_ASSERT_EQ(stats.stallMicros, 8 * byteMicros);
+    TEST_ASSERT_EQ(stats.maxQueued, 32u);
+
+    // mouse fifos are only 8 deep with SerialPIO (pinout v2).
+    usb3sun_pinout_v2();
+    usb3sun_sunm_init(9600);
+    TEST_ASSERT_EQ(usb3sun_sunm_available_for_write(), 8u);
+    usb3sun_sunm_write(data, 5);
+    usb3sun_sunm_write(data, 5);
+    TEST_ASSERT_EQ(usb3sun_test_sunm_stats().stalls, 2u);
+    return true;
+  }
+
+  if (!strcmp(test_name, "latency")) {
+    usb3sun_test_init(0);
+    setup();
+
+    // percentiles are reported as the upper bound of their log2 bucket.
+    latencyReset();
+    for (size_t i = 0; i < 98; i++)
+      latencyRecord(LatencyPath::MOUSE, 10);
+    latencyRecord(LatencyPath::MOUSE, 100);
+    latencyRecord(LatencyPath::MOUSE, 1000);
+    LatencySummary mouse = latencySummary(LatencyPath::MOUSE);
+    TEST_ASSERT_EQ(mouse.count, 100u);
+    TEST_ASSERT_EQ(mouse.p50, 15u);
+    TEST_ASSERT_EQ(mouse.p99, 127u);
+    TEST_ASSERT_EQ(mouse.max, 1000u);
+
+    // each sun byte from a key press is measured from its usb report.
+    latencyReset();
+    const uint8_t press[8]{0, 0, USBK_A, 0, 0, 0, 0, 0};
+    const uint8_t release[8]{};
+    usb3sun_mock_uhid_interface_protocol(USB3SUN_UHID_KEYBOARD);
+    tuh_hid_report_received_cb(1, 0, press, sizeof press);
+    tuh_hid_report_received_cb(1, 0, release, sizeof release);
+#ifdef SUNK_ENABLE
+    TEST_ASSERT_EQ(latencySummary(LatencyPath::KEYBOARD).count, 3u); // make, break, idle
+#else
+    TEST_ASSERT_EQ(latencySummary(LatencyPath::KEYBOARD).count, 0u);
+#endif
+    TEST_ASSERT_EQ(latencySummary(LatencyPath::MACRO).count, 0u);
+
+    // macro keys are measured from when they were queued, so their latency
+    // includes the wait in the queue.
+    latencyReset();
+    macro.press(true, SUNK_STOP);
+    macro.press(false, SUNK_STOP);
+    usb3sun_test_advance_micros(5'000);
+    while (macro.busy())
+      loop1();
+    LatencySummary queued = latencySummary(LatencyPath::MACRO);
+#ifdef SUNK_ENABLE
+    TEST_ASSERT_EQ(queued.count, 3u); // make, break, idle
+    bool waited = queued.max >= 5'000;
+    TEST_ASSERT_EQ(waited, true);
+#else
+    TEST_ASSERT_EQ(queued.count, 0u);
+#endif
+    return true;
+  }
+
+  if (!strcmp(test_name, "macro")) {
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    static std::optional<bool> cancelled{};
+
+    // constant macros are translated at compile time.
+    constexpr size_t US = static_cast<size_t>(KeyboardLayout::_::US);
+    constexpr size_t DE = static_cast<size_t>(KeyboardLayout::_::DE);
+    static_assert(sunkMacro("a!").keys[US][0] == 0x4D);
+    static_assert(sunkMacro("a!").keys[US][1] == SHIFT(0x1E));
+    static_assert(sunkMacro("y-").keys[DE][0] == 0x64);
+    static_assert(sunkMacro("y-").keys[DE][1] == 0x6D);
+
+    // macros are queued, then typed out by loop1() unless paused.
+    sunkSend(SUNK_MACRO("a!"));
+    TEST_ASSERT_EQ(macro.busy(), true);
+    TEST_ASSERT_EQ(macro.percent(), 0u);
+    macro.pause(true);
+    loop1();
+    if (!assert_then_clear_test_history(std::vector<Op> {})) return false;
+    macro.pause(false);
+    loop1();
+    TEST_ASSERT_EQ(macro.busy(), false);
+    TEST_ASSERT_EQ(macro.percent(), 100u);
+    if (!assert_then_clear_test_history(std::vector<Op> {
+#ifdef SUNK_ENABLE
+      SunkWriteOp {bytes(1, "\x4D")}, // SUNK_A
+      SunkWriteOp {bytes(1, "\xCD")},
+      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
+      SunkWriteOp {bytes(1, "\x63")}, // SUNK_SHIFT_L
+      SunkWriteOp {bytes(1, "\x1E")}, // SUNK_1
+      SunkWriteOp {bytes(1, "\x9E")},
+      SunkWriteOp {bytes(1, "\xE3")},
+      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
+#endif
+    })) return false;
+
+    // cancelling drops the rest, but releases any keys held by the macro.
+    macro.press(true, SUNK_STOP);
+    sunkSend("abcdefgh");
+    macro.press(false, SUNK_STOP);
+    macro.onDone([](bool c) { cancelled = c; });
+    loop1();
+    TEST_ASSERT_EQ(macro.percent(), 40u);
+    // core 1 does the cancelling, so it never races with a key being sent.
+    macro.cancel();
+    TEST_ASSERT_EQ(macro.busy(), true);
+    TEST_ASSERT_EQ(cancelled.has_value(), false);
+    loop1();
+    TEST_ASSERT_EQ(macro.busy(), false);
+    TEST_ASSERT_EQ(cancelled.value_or(false), true);
+    if (!assert_then_clear_test_history(std::vector<Op> {
+#ifdef SUNK_ENABLE
+      SunkWriteOp {bytes(1, "\x01")}, // SUNK_STOP
+      SunkWriteOp {bytes(1, "\x4D")}, // SUNK_A
+      SunkWriteOp {bytes(1, "\xCD")},
+      SunkWriteOp {bytes(1, "\x68")}, // SUNK_B
+      SunkWriteOp {bytes(1, "\xE8")},
+      SunkWriteOp {bytes(1, "\x66")}, // SUNK_C
+      SunkWriteOp {bytes(1, "\xE6")},
+      SunkWriteOp {bytes(1, "\x81")},
+      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
+#endif
+    })) return false;
+    return true;
+  }
+
+  if (!strcmp(test_name, "cli_esc_timeout")) {
+#ifndef SUNM_ENABLE
+    TEST_REQUIRES(SUNM_ENABLE);
+#endif
+    usb3sun_test_init(SunmWriteOp::id);
+    setup();
+
+    // Esc then W within the timeout is Alt+W, which moves the sun mouse up.
+    handleCliInput(CliPort::UART, '\x1B');
+    usb3sun_test_advance_micros(99'999);
+    handleCliInput(CliPort::UART, 'w');
+    if (!assert_then_clear_test_history(std::vector<Op> {
+      SunmWriteOp {bytes(5, "\x87\x00\x01\x00\x00")},
+    })) return false;
+
+    // Esc then W after the timeout is just W, which goes to the command line.
+    usb3sun_test_advance_micros(1'000'000);
+    handleCliInput(CliPort::UART, '\x1B');
+    usb3sun_test_advance_micros(100'000);
+    handleCliInput(CliPort::UART, 'w');
+    handleCliInput(CliPort::UART, '\r');
+    return assert_then_clear_test_history(std::vector<Op> {});
+  }
+
+  if (!strcmp(test_name, "cli_commands")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#else
+    usb3sun_test_init(SunkWriteOp::id | FsWriteOp::id);
+    setup();
+    const auto input = [](const char *text) {
+      for (const char *c = text; *c; c++)
+        handleCliInput(CliPort::UART, *c);
+    };
+
+    // spaces between words are kept, and up arrow recalls the last command.
+    input("type  a  b\r");
+    input("\x1B[A\r");
+    while (macro.busy())
+      loop1();
+    std::vector<Op> expected{};
+    append_typed(expected, "a  b");
+    append_typed(expected, "a  b");
+    if (!assert_then_clear_test_history(expected)) return false;
+
+    // settings are checked, and only written when they change.
+    input("settings set keyboardLayout uk\r");
+    input("settings set keyboardLayout uk\r");
+    input("settings set clickDuration 101\r");
+    input("settings set hostid 12ab56\r");
+    TEST_ASSERT_EQ(settings.keyboardLayout.current, KeyboardLayout::_::UK);
+    TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'1', '2', 'A', 'B', '5', '6'}}));
+    if (!assert_then_clear_test_history(std::vector<Op> {
+      FsWriteOp {"/keyboardLayout.v2", bytes(4, "\x01\x00\x00\x00")},
+      FsWriteOp {"/hostid.v2", bytes(6, "\x31\x32\x41\x42\x35\x36")},
+    })) return false;
+
+    // diagnostics only print, and bad arguments only print the usage.
+    input("stats\rhid\rbench\rhistory\rhelp\rsettings\rlatency x\rbogus\r");
+    return assert_then_clear_test_history(std::vector<Op> {});
+#endif
+  }
+
+  if (!strcmp(test_name, "cli_paste")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#else
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    const auto input = [](const char *text) {
+      for (const char *c = text; *c; c++)
+        handleCliInput(CliPort::UART, *c);
+    };
+
+    // newlines can be \r, \r\n or \n, and characters the layout can’t
+    // type are skipped.
+    input("paste\r");
+    input("ab\r\ncd\r\x01\tef\n\x04");
+    while (macro.busy())
+      loop1();
+    std::vector<Op> expected{};
+    append_typed(expected, "ab\ncd\n\tef\n");
+    if (!assert_then_clear_test_history(expected)) return false;
+
+    // when the queue is full, stop reading input until there’s room.
+    input("paste\r");
+    size_t accepted = 0;
+    while (cliReadyForInput(CliPort::UART)) {
+      handleCliInput(CliPort::UART, 'x');
+      accepted++;
+    }
+    TEST_ASSERT_EQ(accepted, Macro::capacity);
+    loop1();
+    TEST_ASSERT_EQ(cliReadyForInput(CliPort::UART), true);
+    input("\x03");
+    TEST_ASSERT_EQ(cliReadyForInput(CliPort::UART), true);
+    loop1();
+    TEST_ASSERT_EQ(macro.busy(), false);
+    expected.clear();
+    append_typed(expected, "xxxx");
+    return assert_then_clear_test_history(expected);
+#endif
+  }
+
+  if (!strcmp(test_name, "cli_ports")) {
+#ifndef SUNK_ENABLE
+    TEST_REQUIRES(SUNK_ENABLE);
+#else
+    usb3sun_test_init(SunkWriteOp::id);
+    setup();
+    const auto input = [](CliPort port, const char *text) {
+      for (const char *c = text; *c; c++)
+        handleCliInput(port, *c);
+    };
+
+    // each port has its own line, so typing on both at once doesn’t mix.
+    input(CliPort::UART, "type ");
+    input(CliPort::CDC, "type b");
+    input(CliPort::UART, "a\r");
+    input(CliPort::CDC, "\r");
+
+    // only the port that started a paste feeds it, and the other port can
+    // still run commands meanwhile (but not start another paste).
+    input(CliPort::UART, "paste\r");
+    input(CliPort::CDC, "paste\rtype d\r");
+    input(CliPort::UART, "c\x04");
+    while (macro.busy())
+      loop1();
+    std::vector<Op> expected{};
+    append_typed(expected, "abdc");
+    return assert_then_clear_test_history(expected);
+#endif
+  }
+
+  if (!strcmp(test_name, "control_protocol")) {
+    usb3sun_test_init(SunkWriteOp::id | SunmWriteOp::id | FsWriteOp::id);
+    setup();
+    // responses that would have gone to the cdc.
+    static std::vector<uint8_t> written{};
+    controlCdc.write = [](const char *data, size_t len) {
+      written.insert(written.end(), data, data + len);
+      return true;
+    };
+    // sends a request to the text cli, like a host on the cdc.
+    const auto send = [](uint8_t type, std::vector<uint8_t> payload) {
+      static uint8_t seq = 0;
+      static ControlFrame request;
+      request.type = type;
+      request.seq = ++seq;
+      request.len = payload.size();
+      std::copy(payload.begin(), payload.end(), request.payload);
+      uint8_t buffer[CONTROL_MAX_FRAME];
+      size_t len = controlEncode(request, buffer);
+      for (size_t i = 0; i < len; i++)
+        handleCliInput(CliPort::CDC, buffer[i]);
+      return request.seq;
+    };
+    // the response to the given request, as (type, status, payload...).
+    const auto response = [](uint8_t seq) {
+      ControlDecoder decoder{};
+      std::vector<uint8_t> result{};
+      for (uint8_t octet : written) {
+        if (decoder.feed(octet, 0) != ControlDecoder::Result::FRAME || decoder.frame.seq != seq)
+          continue;
+        result = bytes(decoder.frame.len, decoder.frame.payload);
+        result.insert(result.begin(), decoder.frame.type);
+      }
+      written.clear();
+      return result;
+    };
+    const auto frame = [](uint8_t type, std::vector<uint8_t> payload) {
+      payload.insert(payload.begin(), type);
+      return payload;
+    };
+    std::vector<uint8_t> got{};
+    const auto ping = static_cast<uint8_t>(ControlType::PING);
+    const auto keys = static_cast<uint8_t>(ControlType::KEYS);
+    const auto mouse = static_cast<uint8_t>(ControlType::MOUSE);
+    const auto stats = static_cast<uint8_t>(ControlType::STATS);
+    const auto get = static_cast<uint8_t>(ControlType::SETTING_GET);
+    const auto set = static_cast<uint8_t>(ControlType::SETTING_SET);
+    const auto trace = static_cast<uint8_t>(ControlType::TRACE);
+    const auto error = static_cast<uint8_t>(ControlType::ERROR);
+    const auto r = CONTROL_RESPONSE;
+    const auto payload = [](const char *text) {
+      return std::vector<uint8_t>{text, text + strlen(text)};
+    };
+
+    got = response(send(ping, payload("hi")));
+    TEST_ASSERT_EQ(got, frame(ping | r, {0, 'h', 'i'}));
+
+    // frames on the debug uart are just text.
+    written.clear();
+    ControlFrame uartPing{ping, 0x55, 0, {}};
+    uint8_t uartBuffer[CONTROL_MAX_FRAME];
+    size_t uartLen = controlEncode(uartPing, uartBuffer);
+    for (size_t i = 0; i < uartLen; i++)
+      handleCliInput(CliPort::UART, uartBuffer[i]);
+    handleCliInput(CliPort::UART, '\r');
+    TEST_ASSERT_EQ(written.empty(), true);
+    got = response(send(0x42, {}));
+    TEST_ASSERT_EQ(got, frame(0x42 | r, {2}));
+
+    // a bad crc gets an error, with the seq if we got that far.
+    written.clear();
+    const char corrupt[] = "\xC5\x01\x09\x00\x00\x00\x00";
+    for (size_t i = 0; i < sizeof corrupt - 1; i++)
+      handleCliInput(CliPort::CDC, corrupt[i]);
+    got = response(9);
+    TEST_ASSERT_EQ(got, frame(error | r, {1}));
+
+    // keys go through the macro queue, in sun make and break codes.
+    uint8_t a = ASCII_TO_SUNK['a'] & 0xFF;
+    uint16_t room = Macro::capacity - 2;
+    got = response(send(keys, {a, static_cast<uint8_t>(a | 0x80)}));
+    TEST_ASSERT_EQ(got, frame(keys | r, {0, static_cast<uint8_t>(room), static_cast<uint8_t>(room >> 8)}));
+    got = response(send(keys, {SUNK_IDLE}));
+    TEST_ASSERT_EQ(got, frame(keys | r, {3}));
+    while (macro.busy())
+      loop1();
+    std::vector<Op> expected{};
+#ifdef SUNK_ENABLE
+    append_typed(expected, "a");
+#endif
+
+    // mouse moves are sent right away, with positive dy down.
+    got = response(send(mouse, {1, 2, 1}));
+    TEST_ASSERT_EQ(got, frame(mouse | r, {0}));
+    got = response(send(mouse, {1, 2}));
+    TEST_ASSERT_EQ(got, frame(mouse | r, {3}));
+#ifdef SUNM_ENABLE
+    expected.push_back(SunmWriteOp {{0x80 | SUNM_CENTER | SUNM_RIGHT, 1, 0xFE, 0, 0}});
+#endif
+
+    std::vector<uint8_t> statsResponse = response(send(stats, {}));
+    auto statCount = static_cast<size_t>(Stat::VALUE_COUNT);
+    TEST_ASSERT_EQ(statsResponse.size(), 3 + statCount * 4);
+    TEST_ASSERT_EQ(static_cast<size_t>(statsResponse[2]), statCount);
+    size_t sunmTx = 3 + static_cast<size_t>(Stat::SUNM_TX) * 4;
+    TEST_ASSERT_EQ(static_cast<uint32_t>(statsResponse[sunmTx]), statsGet(Stat::SUNM_TX));
+
+    // settings are text, as in the `settings` command.
+    got = response(send(set, payload("clickDuration 42")));
+    TEST_ASSERT_EQ(got, frame(set | r, {0, '4', '2'}));
+    got = response(send(get, payload("clickDuration")));
+    TEST_ASSERT_EQ(got, frame(get | r, {0, '4', '2'}));
+    got = response(send(set, payload("clickDuration 999")));
+    TEST_ASSERT_EQ(got, frame(set | r, {3}));
+    got = response(send(get, payload("nope")));
+    TEST_ASSERT_EQ(got, frame(get | r, {3}));
+    expected.push_back(FsWriteOp {"/clickDuration.v2", {42, 0, 0, 0, 0, 0, 0, 0}});
+    if (!assert_then_clear_test_history(expected)) return false;
+
+    // the trace starts with the boot, and the cursor moves past what we got.
+    std::vector<uint8_t> traceResponse = response(send(trace, {0, 0, 0, 0, 0}));
+    TEST_ASSERT_EQ((traceResponse.size() >= 7 + CONTROL_TRACE_ENTRY_SIZE), true);
+    size_t entries = (traceResponse.size() - 7) / CONTROL_TRACE_ENTRY_SIZE;
+    TEST_ASSERT_EQ(static_cast<size_t>(traceResponse[3]), entries);
+    TEST_ASSERT_EQ(static_cast<unsigned>(traceResponse[7 + 4]), static_cast<unsigned>(TraceEvent::BOOT));
+
+    // the client library, over a socket served like the linux hal does.
+    int fds[2];
+    TEST_ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    static int serverFd;
+    serverFd = fds[1];
+    std::thread server{[] {
+      ControlPort port{[](const char *data, size_t len) {
+        return write(serverFd, data, len) == static_cast<ssize_t>(len);
+      }, {}};
+      uint8_t octet;
+      // debug output in between frames is skipped.
+      if (write(serverFd, "log\n", 4) != 4)
+        return;
+      while (read(serverFd, &octet, 1) == 1)
+        port.input(octet);
+    }};
+    ControlClient client{};
+    client.attach(fds[0]);
+    std::string value{};
+    uint32_t cursor = 0;
+    std::vector<TraceEntry> traced{};
+    ControlStatus pingStatus = client.ping("hello");
+    ControlStatus getStatus = client.settingGet("clickDuration", value);
+    ControlStatus traceStatus = client.trace(0, cursor, traced);
+    client.close();
+    server.join();
+    close(serverFd);
+    TEST_ASSERT_EQ(static_cast<unsigned>(pingStatus), 0u);
+    TEST_ASSERT_EQ(static_cast<unsigned>(getStatus), 0u);
+    TEST_ASSERT_EQ(value, "42");
+    TEST_ASSERT_EQ(static_cast<unsigned>(traceStatus), 0u);
+    TEST_ASSERT_EQ(traced.size(), entries);
+    TEST_ASSERT_EQ(cursor, entries);
+    TEST_ASSERT_EQ(static_cast<unsigned>(traced[0].event), static_cast<unsigned>(TraceEvent::BOOT));
+    return true;
+  }
+
+  if (!strcmp(test_name, "debug_binary")) {
+#ifndef DEBUG_BINARY
+    TEST_REQUIRES(DEBUG_BINARY);
+#else
+    // records decoded against our own elf should match printf exactly.
+    std::string log{};
+    std::string expected{};
+#define TEST_DEBUG_RECORD(...) do { \
+      DebugRecord record{}; \
+      bool ok = Pinout::debugEncode(record, __VA_ARGS__); \
+      TEST_ASSERT_EQ(ok, true); \
+      log.append(reinterpret_cast<const char *>(record.data), record.len); \
+      char text[512]; \
+      snprintf(text, sizeof text, __VA_ARGS__); \
+      expected += text; \
+    } while (0)
+    int local = 0;
+    std::string longest(DebugRecord::maxString, 'x');
+    TEST_DEBUG_RECORD("plain text\n");
+    TEST_DEBUG_RECORD("%d %i %u %ld\n", -1, INT32_MIN, UINT32_MAX, static_cast<long>(INT32_MIN) * 3);
+    TEST_DEBUG_RECORD("%02X %04x %#o %c %%\n", 0xA, 0xBEEFu, 8u, 'c');
+    TEST_DEBUG_RECORD("%llu %lld\n", static_cast<unsigned long long>(UINT64_MAX), static_cast<long long>(INT64_MIN));
+    TEST_DEBUG_RECORD("%p\n", static_cast<void *>(&local));
+    TEST_DEBUG_RECORD("%.3f %g %e\n", 3.14159, 0.5f, -1e100);
+    TEST_DEBUG_RECORD("<%s> <%8s> <%-8s> <%s>\n", "", "right", "left", longest.c_str());
+    log += "text outside of records\n";
+    expected += "text outside of records\n";
+#undef TEST_DEBUG_RECORD
+
+    // and anything too big for a record says so, so debugLog can print it.
+    std::string longer(DebugRecord::maxString + 1, 'x');
+    DebugRecord record{};
+    bool ok = Pinout::debugEncode(record, "%s\n", longer.c_str());
+    TEST_ASSERT_EQ(ok, false);
+    record = {};
+    ok = Pinout::debugEncode(record, "%s%s%s%s%s\n", longest.c_str(), longest.c_str(), longest.c_str(), longest.c_str(), longest.c_str());
+    TEST_ASSERT_EQ(ok, false);
+
+    FILE *input = fmemopen(log.data(), log.size(), "rb");
+    char *decoded = nullptr;
+    size_t decodedLen = 0;
+    FILE *output = open_memstream(&decoded, &decodedLen);
+    int status = decodeDebugLog("/proc/self/exe", input, output);
+    fclose(input);
+    fclose(output);
+    std::string actual{decoded, decodedLen};
+    free(decoded);
+    TEST_ASSERT_EQ(status, 0);
+    TEST_ASSERT_EQ(actual, expected);
+    return true;
+#endif
+  }
+
   const auto findMenuItem = [](uint8_t usbkSelector, MenuItem targetItem) {
     auto oldItem = MENU_VIEW.selectedItem;
     while (MENU_VIEW.selectedItem != (size_t)targetItem) {
@@ -1172,11 +2179,9 @@ static bool run_test(const char *test_name) {
     View::sendMakeBreak({}, USBK_RETURN); // Go back
     TEST_ASSERT_EQ(View::peek(), &DEFAULT_VIEW);
     TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'0', '0', '0', '0', '0', '0'}}));
+    // the break of the return that closed the menu isn’t sent to the sun,
+    // because the sun never saw its make.
     if (!assert_then_clear_test_history(std::vector<Op> {
-#ifdef SUNK_ENABLE
-      SunkWriteOp {bytes(1, "\xD9")}, // SUNK_RETURN
-      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
-#endif
     })) return false;
 
     // confirm-save when hostid is changed and we say ok,
@@ -1189,40 +2194,31 @@ static bool run_test(const char *test_name) {
     View::sendMakeBreak({}, USBK_RETURN); // ok
     findMenuItem(USBK_DOWN, MenuItem::ReprogramIdprom);
     View::sendMakeBreak({}, USBK_RETURN); // Reprogram idprom
+    TEST_ASSERT_EQ(View::peek(), &WAIT_VIEW);
+    while (macro.busy())
+      loop1();
     TEST_ASSERT_EQ(View::peek(), &SAVE_SETTINGS_VIEW);
     View::sendMakeBreak({}, USBK_ESCAPE); // cancel
     TEST_ASSERT_EQ(View::peek(), &MENU_VIEW);
-    View::sendMakeBreak({}, USBK_RETURN); // Go back
+    View::sendMakeBreak({}, USBK_RETURN); // Reprogram idprom (again)
+    TEST_ASSERT_EQ(View::peek(), &WAIT_VIEW);
+    while (macro.busy())
+      loop1();
     TEST_ASSERT_EQ(View::peek(), &SAVE_SETTINGS_VIEW);
     View::sendMakeBreak({}, USBK_N); // don't save
     TEST_ASSERT_EQ(View::peek(), &DEFAULT_VIEW);
     TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'0', '0', '0', '0', '0', '0'}}));
     std::vector<Op> expected{};
 #ifdef SUNK_ENABLE
-    for (const auto &octet : bytes(
-      1202,
-      "\x1E\x9E\x7F\x79\xF9\x7F\x27\xA7\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x39\xB9\x7F\x38\xB8\x7F\x4D\xCD\x7F\x55\xD5\x7F\x28\xA8\x7F\x6A\xEA\x7F\x4D\xCD\x7F\x66\xE6\x7F\x52\xD2\x7F\x3D\xBD\x7F\x69\xE9\x7F\x38\xB8\x7F\x28\xA8\x7F\x3A"
-      "\xBA\x7F\x3B\xBB\x7F\x3F\xBF\x7F\x38\xB8\x7F\x79\xF9\x7F\x1E\x9E\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x25\xA5\x7F\x79\xF9\x7F\x1F\x9F\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x20\xA0"
-      "\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1F\x9F\x7F\x27\xA7\x7F\x79\xF9\x7F\x21\xA1\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1E\x9E\x7F\x27\xA7\x7F\x79\xF9\x7F\x22\xA2\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F"
-      "\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x23\xA3\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x24\xA4\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x39\xB9\x7F\x38\xB8\x7F\x4D\xCD\x7F\x55"
-      "\xD5\x7F\x28\xA8\x7F\x6A\xEA\x7F\x4D\xCD\x7F\x66\xE6\x7F\x52\xD2\x7F\x3D\xBD\x7F\x69\xE9\x7F\x38\xB8\x7F\x28\xA8\x7F\x3A\xBA\x7F\x3B\xBB\x7F\x3F\xBF\x7F\x38\xB8\x7F\x79\xF9\x7F\x25\xA5\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7"
-      "\x7F\x79\xF9\x7F\x26\xA6\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x4D\xCD\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x68\xE8\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F"
-      "\x3F\xBF\x7F\x59\xD9\x7F\x1E\x9E\x7F\x27\xA7\x7F\x79\xF9\x7F\x66\xE6\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x4F\xCF\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x38"
-      "\xB8\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1F\x9F\x7F\x26\xA6\x7F\x79\xF9\x7F\x50\xD0\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x3C\xBC\x7F\x3F\xBF\x7F\x4F\xCF\x7F\x4D\xCD\x7F\x3A\xBA\x7F\x38\xB8\x7F\x28\xA8"
-      "\x7F\x4E\xCE\x7F\x3B\xBB\x7F\x4E\xCE\x7F\x3A\xBA\x7F\x38\xB8\x7F\x6A\xEA\x7F\x28\xA8\x7F\x3D\xBD\x7F\x4F\xCF\x7F\x3F\xBF\x7F\x39\xB9\x7F\x3E\xBE\x7F\x6A\xEA\x7F\x59\xD9\x7F\x6C\xEC\x7F\x3D\xBD\x7F\x4F\xCF\x7F\x3F\xBF\x7F\x39\xB9\x7F\x3E\xBE\x7F\x6A\xEA\x7F"
-      "\x59\xD9\x7F\x68\xE8\x7F\x4D\xCD\x7F\x69\xE9\x7F\x69\xE9\x7F\x38\xB8\x7F\x39\xB9\x7F\x59\xD9\x7F\x1E\x9E\x7F\x79\xF9\x7F\x27\xA7\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x39\xB9\x7F\x38\xB8\x7F\x4D\xCD\x7F\x55\xD5\x7F\x28\xA8\x7F\x6A"
-      "\xEA\x7F\x4D\xCD\x7F\x66\xE6\x7F\x52\xD2\x7F\x3D\xBD\x7F\x69\xE9\x7F\x38\xB8\x7F\x28\xA8\x7F\x3A\xBA\x7F\x3B\xBB\x7F\x3F\xBF\x7F\x38\xB8\x7F\x79\xF9\x7F\x1E\x9E\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x25\xA5\x7F\x79\xF9\x7F\x1F\x9F"
-      "\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x20\xA0\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1F\x9F\x7F\x27\xA7\x7F\x79\xF9\x7F\x21\xA1\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F"
-      "\x59\xD9\x7F\x1E\x9E\x7F\x27\xA7\x7F\x79\xF9\x7F\x22\xA2\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x23\xA3\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x24\xA4\x7F\x79"
-      "\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x39\xB9\x7F\x38\xB8\x7F\x4D\xCD\x7F\x55\xD5\x7F\x28\xA8\x7F\x6A\xEA\x7F\x4D\xCD\x7F\x66\xE6\x7F\x52\xD2\x7F\x3D\xBD\x7F\x69\xE9\x7F\x38\xB8\x7F\x28\xA8\x7F\x3A\xBA\x7F\x3B\xBB\x7F\x3F\xBF\x7F\x38\xB8"
-      "\x7F\x79\xF9\x7F\x25\xA5\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x26\xA6\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x4D\xCD\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F"
-      "\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x68\xE8\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1E\x9E\x7F\x27\xA7\x7F\x79\xF9\x7F\x66\xE6\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x4F"
-      "\xCF\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x27\xA7\x7F\x79\xF9\x7F\x38\xB8\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF\x7F\x59\xD9\x7F\x1F\x9F\x7F\x26\xA6\x7F\x79\xF9\x7F\x50\xD0\x7F\x79\xF9\x7F\x6A\xEA\x7F\x54\xD4\x7F\x3F\xBF"
-      "\x7F\x59\xD9\x7F\x3C\xBC\x7F\x3F\xBF\x7F\x4F\xCF\x7F\x4D\xCD\x7F\x3A\xBA\x7F\x38\xB8\x7F\x28\xA8\x7F\x4E\xCE\x7F\x3B\xBB\x7F\x4E\xCE\x7F\x3A\xBA\x7F\x38\xB8\x7F\x6A\xEA\x7F\x28\xA8\x7F\x3D\xBD\x7F\x4F\xCF\x7F\x3F\xBF\x7F\x39\xB9\x7F\x3E\xBE\x7F\x6A\xEA\x7F"
-      "\x59\xD9\x7F\x6C\xEC\x7F\x3D\xBD\x7F\x4F\xCF\x7F\x3F\xBF\x7F\x39\xB9\x7F\x3E\xBE\x7F\x6A\xEA\x7F\x59\xD9\x7F\x68\xE8\x7F\x4D\xCD\x7F\x69\xE9\x7F\x69\xE9\x7F\x38\xB8\x7F\x39\xB9\x7F\x59\xD9\x7F\xE9\x7F"
-    )) {
-      expected.push_back(SunkWriteOp {bytes(1, &octet)});
+    for (size_t i = 0; i < 2; i++) {
+      append_typed(expected,
+        "29 0 0 10 0 0 0 real-machine-type 0 0 10 20 0 8 real-machine-type 1 10 0 do i mkp loop\n"
+        "update-system-idprom\n"
+        ".idprom\n"
+        "banner\n");
     }
+    // but not the break for N, which goes to the default view after the
+    // confirm-save closes, because the sun never saw its make.
 #endif
     if (!assert_then_clear_test_history(expected)) return false;
 
@@ -1240,10 +2236,6 @@ static bool run_test(const char *test_name) {
     TEST_ASSERT_EQ(View::peek(), &DEFAULT_VIEW);
     TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'0', '0', '0', '0', '0', '0'}}));
     if (!assert_then_clear_test_history(std::vector<Op> {
-#ifdef SUNK_ENABLE
-      SunkWriteOp {bytes(1, "\xD9")}, // SUNK_RETURN
-      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
-#endif
     })) return false;
 
     // when the hostid setting is changed, the setting should change in memory,
@@ -1261,10 +2253,6 @@ static bool run_test(const char *test_name) {
     TEST_ASSERT_EQ(settings.hostid, (HostidV2::Value {{'1', '0', '0', '0', '0', '0'}}));
     if (!assert_then_clear_test_history(std::vector<Op> {
       FsWriteOp {"/hostid.v2", bytes(6, "\x31\x30\x30\x30\x30\x30")},
-#ifdef SUNK_ENABLE
-      SunkWriteOp {bytes(1, "\xD9")}, // SUNK_RETURN
-      SunkWriteOp {bytes(1, "\x7F")}, // SUNK_IDLE
-#endif
     })) return false;
 
     return true;
@@ -1289,6 +2277,8 @@ static void handleDemoInput(std::optional<uint8_t> cur) {
             break;
           case 'q':
             usb3sun_test_terminal_demo_mode(false);
+            std::cerr << ">>> sun keyboard: " << usb3sun_test_sunk_stats() << "\n";
+            std::cerr << ">>> sun mouse: " << usb3sun_test_sunm_stats() << "\n";
             exit(0);
             break;
           default:
@@ -1367,12 +2357,131 @@ static void initDisplay(const char *outputPath) {
   }
 }
 
+// runs each test in its own process, up to `jobs` at a time, printing each
+// test’s output as a block when it finishes, then a summary slowest first.
+static int run_all_tests(size_t jobs, const char *jsonPath) {
+  using Clock = std::chrono::steady_clock;
+  struct Job {
+    const char *name;
+    pid_t pid;
+    FILE *output;
+    Clock::time_point start;
+  };
+  struct Result {
+    const char *name;
+    bool ok;
+    double seconds;
+  };
+  std::vector<Job> running{};
+  std::vector<Result> results{};
+  size_t next = 0;
+  while (next < test_names.size() || !running.empty()) {
+    while (next < test_names.size() && running.size() < jobs) {
+      const char *name = test_names[next++];
+      FILE *output = tmpfile();
+      if (!output) {
+        perror("fatal: tmpfile");
+        return 1;
+      }
+      // don’t let the child inherit (and flush) anything we haven’t written yet.
+      fflush(stdout);
+      fflush(stderr);
+      pid_t pid = fork();
+      if (pid == 0) {
+        dup2(fileno(output), STDOUT_FILENO);
+        dup2(fileno(output), STDERR_FILENO);
+        setvbuf(stdout, nullptr, _IOLBF, 0);
+        bool ok = run_test(name);
+        pinout.debugFlush();
+        if (!ok)
+          std::cerr << ">>> test failed: " << name << "\n";
+        exit(ok ? 0 : 1);
+      } else if (pid == -1) {
+        perror("fatal: fork");
+        return 1;
+      }
+      running.push_back(Job {name, pid, output, Clock::now()});
+    }
+    int result;
+    pid_t pid = wait(&result);
+    if (pid == -1) {
+      perror("fatal: wait");
+      return 1;
+    }
+    auto job = std::find_if(running.begin(), running.end(), [pid](const Job &job) { return job.pid == pid; });
+    if (job == running.end())
+      continue;
+    std::chrono::duration<double> elapsed = Clock::now() - job->start;
+    bool ok = WIFEXITED(result) && WEXITSTATUS(result) == 0;
+    std::cerr << ">>> starting test: " << job->name << "\n" << std::flush;
+    rewind(job->output);
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof buffer, job->output)) > 0)
+      fwrite(buffer, 1, len, stderr);
+    fclose(job->output);
+    if (!ok)
+      std::cerr << ">>> test failed: " << job->name << ": wait(2) returned " << result << "\n";
+    results.push_back(Result {job->name, ok, elapsed.count()});
+    running.erase(job);
+  }
+
+  std::sort(results.begin(), results.end(), [](const Result &p, const Result &q) { return p.seconds > q.seconds; });
+  size_t failed = std::count_if(results.begin(), results.end(), [](const Result &r) { return !r.ok; });
+  fprintf(stderr, ">>> %zu passed, %zu failed, slowest first:\n", results.size() - failed, failed);
+  for (const auto &r : results)
+    fprintf(stderr, "    %8.3f s  %s%s\n", r.seconds, r.name, r.ok ? "" : " (FAILED)");
+
+  if (jsonPath) {
+    FILE *json = fopen(jsonPath, "w");
+    if (!json) {
+      perror("fatal: fopen");
+      return 1;
+    }
+    fprintf(json, "{\"passed\": %zu, \"failed\": %zu, \"tests\": [", results.size() - failed, failed);
+    for (size_t i = 0; i < results.size(); i++) {
+      fprintf(json, "%s\n  {\"name\": \"%s\", \"ok\": %s, \"seconds\": %.6f}",
+        i > 0 ? "," : "", results[i].name, results[i].ok ? "true" : "false", results[i].seconds);
+    }
+    fprintf(json, "\n]}\n");
+    fclose(json);
+  }
+  return failed > 0 ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
   if (argc >= 2) {
     const char *test_name = argv[1];
     if (!strcmp(test_name, "demo")) {
-      if (argc >= 3) {
-        initDisplay(argv[2]);
+      // --threads runs each core on its own thread, like the real thing.
+      bool threads = false;
+      bool ptys = false;
+      bool pacing = false;
+      const char *controlPath = nullptr;
+      const char *displayPath = nullptr;
+      for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads")) {
+          threads = true;
+        } else if (!strcmp(argv[i], "--pty")) {
+          ptys = true;
+        } else if (!strcmp(argv[i], "--pace")) {
+          pacing = true;
+        } else if (!strcmp(argv[i], "--control") && i + 1 < argc) {
+          controlPath = argv[++i];
+        } else if (argv[i][0] != '-' && !displayPath) {
+          displayPath = argv[i];
+        } else {
+          help();
+          return 1;
+        }
+      }
+      if (ptys && !usb3sun_test_sun_ptys())
+        return 1;
+      if (controlPath && !usb3sun_test_control_socket(controlPath))
+        return 1;
+      usb3sun_test_uart_model(pacing);
+      if (displayPath) {
+        initDisplay(displayPath);
       } else {
         char displayPath[] = "/tmp/usb3sun.XXXXXX\0display";
         if (mkdtemp(displayPath)) {
@@ -1385,8 +2494,18 @@ int main(int argc, char **argv) {
       usb3sun_test_init(0);
       usb3sun_test_exit_on_reboot();
       usb3sun_test_terminal_demo_mode(true);
-      setup();
-      setup1();
+      std::thread core1{};
+      if (threads) {
+        core1 = usb3sun_test_start_core1([] {
+          setup1();
+          while (true)
+            loop1();
+        });
+        setup();
+      } else {
+        setup();
+        setup1();
+      }
       while (true) {
         constexpr size_t escAltTimeout = 100'000ul;
         static char prev = '\0';
@@ -1407,35 +2526,82 @@ int main(int argc, char **argv) {
           }
         }
         loop();
-        loop1();
+        // like the arduino core, which calls this after loop if there’s input.
+        if (ptys)
+          serialEvent1();
+        if (!threads)
+          loop1();
       }
-    } else if (!strcmp(test_name, "all")) {
-      for (const char *&name : test_names) {
-        std::cerr << ">>> starting test: " << name << "\n";
-        test_name = name;
-        pid_t pid = fork();
-        if (pid == 0) {
-          if (run_test(test_name)) {
-            return 0;
-          } else {
-            std::cerr << ">>> test failed: " << test_name << "\n";
+    } else if (!strcmp(test_name, "decode")) {
+      if (argc < 3) {
+        help();
+        return 1;
+      }
+      FILE *input = stdin;
+      if (argc >= 4 && !(input = fopen(argv[3], "rb"))) {
+        perror("fatal: fopen");
+        return 1;
+      }
+      return decodeDebugLog(argv[2], input);
+    } else if (!strcmp(test_name, "control")) {
+      // with no command, this prints the commands.
+      return controlMain(argc >= 3 ? argv[2] : nullptr, std::max(argc - 3, 0), &argv[std::min(argc, 3)]);
+    } else if (!strcmp(test_name, "replay")) {
+      if (argc < 3) {
+        help();
+        return 1;
+      }
+      double speed = 1;
+      std::ofstream file{};
+      for (int i = 3; i < argc; i++) {
+        if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+          speed = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+          file.open(argv[++i]);
+          if (!file) {
+            perror("fatal: failed to open output");
             return 1;
           }
-        } else if (pid == -1) {
-          perror("fatal: fork");
+        } else {
+          help();
           return 1;
+        }
+      }
+      FILE *input = stdin;
+      if (strcmp(argv[2], "-") && !(input = fopen(argv[2], "r"))) {
+        perror("fatal: fopen");
+        return 1;
+      }
+      return replayCapture(input, speed, file.is_open() ? file : std::cout);
+    } else if (!strcmp(test_name, "all")) {
+      long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+      const char *jsonPath = nullptr;
+      for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+          jobs = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+          jsonPath = argv[++i];
         } else {
-          int result;
-          wait(&result);
-          if (!WIFEXITED(result) || WEXITSTATUS(result) != 0) {
-            std::cerr << "fatal: wait(2) returned " << result << "\n";
-            return 1;
-          }
+          help();
+          return 1;
         }
       }
-      return 0;
+      return run_all_tests(jobs > 0 ? jobs : 1, jsonPath);
     } else {
-      return run_test(test_name) ? 0 : 1;
+      std::ofstream historyDump{};
+      if (argc >= 4 && !strcmp(argv[2], "--history")) {
+        historyDump.open(argv[3]);
+        if (!historyDump) {
+          perror("fatal: failed to open history dump");
+          return 1;
+        }
+        usb3sun_test_history_dump(&historyDump);
+      }
+      bool ok = run_test(test_name);
+      // dump whatever the test didn’t assert on.
+      usb3sun_test_clear_history();
+      pinout.debugFlush();
+      return ok ? 0 : 1;
     }
   }
   help();
@@ -8,7 +8,9 @@
 #include "bindings.h"
 #include "hal.h"
 #include "hostid.h"
+#include "macro.h"
 #include "pinout.h"
+#include "remap.h"
 #include "settings.h"
 #include "state.h"
 #include "sunk.h"
@@ -46,6 +48,13 @@ static const MenuItemPainter MENU_ITEM_PAINTERS[] = {
       : newSettings.mouseBaud == MouseBaud::_::S9600 ? "9600"
       : "?");
   },
+  [](int16_t &marqueeX, size_t i, bool on) {
+    drawMenuItem(marqueeX, i, on, "Keyboard layout: %s",
+      newSettings.keyboardLayout == KeyboardLayout::_::US ? "US"
+      : newSettings.keyboardLayout == KeyboardLayout::_::UK ? "UK"
+      : newSettings.keyboardLayout == KeyboardLayout::_::DE ? "DE"
+      : "?");
+  },
   [](int16_t &marqueeX, size_t i, bool on) {
     drawMenuItem(marqueeX, i, on, "Hostid: %c%c%c%c%c%c",
       newSettings.hostid[0],
@@ -97,16 +106,6 @@ static void drawMenuItem(int16_t &marqueeX, size_t i, bool on, const char *fmt,
   }
 }
 
-unsigned decodeHex(unsigned char digit) {
-  if (digit >= '0' && digit <= '9')
-    return digit - '0';
-  if (digit >= 'A' && digit <= 'F')
-    return digit - 'A' + 10;
-  if (digit >= 'a' && digit <= 'f')
-    return digit - 'a' + 10;
-  return 0;
-}
-
 void MenuView::open() {
   if (isOpen)
     return;
@@ -153,6 +152,12 @@ void MenuView::handleKey(const UsbkChanges &changes) {
       sel(changes.sel[i].usbkSelector);
 }
 
+// the macro finishes on loop1(), after sel() has returned.
+static void closeWhenMacroDone(bool) {
+  WAIT_VIEW.close();
+  MENU_VIEW.close();
+}
+
 void MenuView::sel(uint8_t usbkSelector) {
   switch (usbkSelector) {
     case USBK_ESCAPE:
@@ -172,6 +177,9 @@ void MenuView::sel(uint8_t usbkSelector) {
         case (size_t)MenuItem::MouseBaud:
           ++newSettings.mouseBaud;
           break;
+        case (size_t)MenuItem::KeyboardLayout:
+          ++newSettings.keyboardLayout;
+          break;
       }
       break;
     case USBK_LEFT:
@@ -188,6 +196,9 @@ void MenuView::sel(uint8_t usbkSelector) {
         case (size_t)MenuItem::MouseBaud:
           --newSettings.mouseBaud;
           break;
+        case (size_t)MenuItem::KeyboardLayout:
+          --newSettings.keyboardLayout;
+          break;
       }
       break;
     case USBK_RETURN:
@@ -201,65 +212,16 @@ void MenuView::sel(uint8_t usbkSelector) {
           break;
         case (size_t)MenuItem::ReprogramIdprom: {
           WAIT_VIEW.open("Reprogramming...", newSettings.hostid);
-
-          unsigned hostid24 =
-            decodeHex(newSettings.hostid[0]) << 20
-            | decodeHex(newSettings.hostid[1]) << 16
-            | decodeHex(newSettings.hostid[2]) << 12
-            | decodeHex(newSettings.hostid[3]) << 8
-            | decodeHex(newSettings.hostid[4]) << 4
-            | decodeHex(newSettings.hostid[5]);
-
-          unsigned i = 0;
-          // https://funny.computer.daz.cat/sun/nvram-hostid-faq.txt
-          // version 1
-          sunkSend("1 %x mkp\n", i++);
-
-          // hostid byte 1/4 (system type)
-          sunkSend("real-machine-type %x mkp\n", i++);
-
-          // ethernet address oui (always 08:00:20)
-          sunkSend("8 %x mkp\n", i++);
-          sunkSend("0 %x mkp\n", i++);
-          sunkSend("20 %x mkp\n", i++);
-
-          // set ethernet address lower half such that hostid bytes 2/3/4
-          // cancels it out in the checksum
-          sunkSend("%x %x mkp\n", hostid24 >> 16 & 0xFF, i++);
-          sunkSend("%x %x mkp\n", hostid24 >> 8 & 0xFF, i++);
-          sunkSend("%x %x mkp\n", hostid24 >> 0 & 0xFF, i++);
-
-          // set date of manufacture such that the system type byte
-          // cancels it out in the checksum
-          sunkSend("real-machine-type %x mkp\n", i++);
-          sunkSend("0 %x mkp\n", i++);
-          sunkSend("0 %x mkp\n", i++);
-          sunkSend("0 %x mkp\n", i++);
-
-          // hostid bytes 2/3/4
-          sunkSend("%x %x mkp\n", hostid24 >> 16 & 0xFF, i++);
-          sunkSend("%x %x mkp\n", hostid24 >> 8 & 0xFF, i++);
-          sunkSend("%x %x mkp\n", hostid24 >> 0 & 0xFF, i++);
-
-          // 01h ^ 08h ^ 20h = 29h
-          // sunkSend("0 %x 0 do i idprom@ xor loop f mkp\n", i++);
-          sunkSend("29 %x mkp\n", i++);
-
-          // only needed for SS1000, but harmless otherwise
-          sunkSend("update-system-idprom\n");
-
-          sunkSend(".idprom\n");
-          sunkSend("banner\n");
-
-          WAIT_VIEW.close();
-          close();
+          char script[128];
+          idpromReprogramScript(script, sizeof script, newSettings.hostid);
+          sunkSend("%s", script);
+          sunkSend(IDPROM_REPROGRAM_EPILOGUE);
+          macro.onDone(closeWhenMacroDone);
         } break;
         case (size_t)MenuItem::WipeIdprom: {
           WAIT_VIEW.open("Wiping...", {});
-          for (unsigned i = 0; i < 0xF; i++)
-            sunkSend("aa %x mkp\n", i);
-          WAIT_VIEW.close();
-          close();
+          sunkSend(IDPROM_WIPE_SCRIPT);
+          macro.onDone(closeWhenMacroDone);
         } break;
       }
       break;
@@ -287,16 +249,32 @@ const char *WaitView::name() const {
 }
 
 void WaitView::handlePaint() {
-  usb3sun_display_text(8, 8, false, message);
+  char messageText[32];
+  snprintf(messageText, sizeof messageText, "%s %u%%", message, macro.percent());
+  usb3sun_display_text(8, 8, false, messageText);
   if (hostid.has_value()) {
     char hostidText[] = "Hostid: ??????";
     for (size_t i = 0; i < sizeof hostid->value; i++)
       hostidText[sizeof "Hostid: " - 1 + i] = hostid->value[i];
     usb3sun_display_text(8, 16, false, hostidText);
   }
+  usb3sun_display_text(8, 24, false, macro.isPaused() ? "Space: resume" : "Esc: cancel");
 }
 
-void WaitView::handleKey(const UsbkChanges &) {}
+void WaitView::handleKey(const UsbkChanges &changes) {
+  for (size_t i = 0; i < changes.selLen; i++) {
+    if (!changes.sel[i].make)
+      continue;
+    switch (changes.sel[i].usbkSelector) {
+      case USBK_ESCAPE:
+        macro.cancel();
+        break;
+      case USBK_SPACE:
+        macro.pause(!macro.isPaused());
+        break;
+    }
+  }
+}
 
 void WaitView::open(const char *message, std::optional<HostidV2::Value> hostid) {
   if (isOpen)
@@ -356,6 +334,11 @@ void SaveSettingsView::handleKey(const UsbkChanges &changes) {
             settings.hostid = newSettings.hostid;
             settings.write<HostidV2>(settings.hostid);
           }
+          if (newSettings.keyboardLayout != settings.keyboardLayout) {
+            settings.keyboardLayout = newSettings.keyboardLayout;
+            settings.write<KeyboardLayoutV2>(settings.keyboardLayout);
+            remapRebuild();
+          }
           if (doReboot) {
             usb3sun_reboot();
           } else if (doRestartSunm) {
@@ -13,6 +13,7 @@ enum class MenuItem : size_t {
   ForceClick,
   ClickDuration,
   MouseBaud,
+  KeyboardLayout,
   Hostid,
   ReprogramIdprom,
   WipeIdprom,
@@ -11,6 +11,8 @@ void panic2(const char *fmt, Args... args) {
     Sprint("panic: ");
     Sprintf(fmt, args...);
     Sprintln();
+    // we’re about to halt, so flush even if we’re not core 0.
+    pinout.debugFlushForPanic();
     usb3sun_panic(fmt, args...);
 }
 
@@ -1,6 +1,8 @@
 #include "config.h"
 #include "pinout.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
@@ -8,6 +10,75 @@
 #include "hal.h"
 #include "settings.h"
 
+// single-producer single-consumer ring of debug output. each core writes to
+// its own ring, and core 0 drains both rings in its idle time, so logging on
+// core 1 (the usb host and key path) never waits for the debug uart or cdc.
+// the only other consumer is a panic on core 1, which takes over its ring.
+struct DebugRing {
+  static const size_t size = 4096; // must be a power of two
+  char data[size];
+  std::atomic<size_t> head{0}; // written by producer only
+  std::atomic<size_t> tail{0}; // written by consumer only
+  std::atomic<uint32_t> dropped{0}; // written by producer only
+  uint32_t droppedReported = 0; // consumer only
+  // held while draining, so there is only ever one consumer at a time.
+  std::atomic<bool> draining{false};
+
+  // writes all of the given text plus the suffix, or none of it if there is
+  // not enough space. the caller decides whether that counts as a drop.
+  bool push(const char *text, size_t len, const char *suffix = "", size_t suffixLen = 0) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    if (len + suffixLen > size - (h - t))
+      return false;
+    for (size_t i = 0; i < len; i++)
+      data[(h + i) & (size - 1)] = text[i];
+    for (size_t i = 0; i < suffixLen; i++)
+      data[(h + len + i) & (size - 1)] = suffix[i];
+    head.store(h + len + suffixLen, std::memory_order_release);
+    return true;
+  }
+
+  // producer only.
+  void drop() {
+    dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // returns false without draining if another consumer is draining, unless
+  // wait is true.
+  bool drain(bool (*write)(const char *data, size_t len), bool wait = false) {
+    while (draining.exchange(true, std::memory_order_acquire))
+      if (!wait)
+        return false;
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    while (t != h) {
+      // write the contiguous part up to the end of the buffer, then wrap.
+      size_t start = t & (size - 1);
+      size_t len = std::min(h - t, size - start);
+      write(&data[start], len);
+      t += len;
+      tail.store(t, std::memory_order_release);
+    }
+    uint32_t d = dropped.load(std::memory_order_relaxed);
+    if (d != droppedReported) {
+      char message[64];
+      int len = snprintf(message, sizeof message, "\ndebug: dropped %u messages\n", static_cast<unsigned>(d - droppedReported));
+      if (len > 0)
+        write(message, std::min(static_cast<size_t>(len), sizeof message - 1));
+      droppedReported = d;
+    }
+    draining.store(false, std::memory_order_release);
+    return true;
+  }
+};
+
+static DebugRing debugRings[2]{};
+
+#if defined(DEBUG_BINARY)
+const char debugFormatAnchor[] = "usb3sun debug format anchor";
+#endif
+
 // TODO add Print::vprintf in ArduinoCore-API Print.h
 static int vprintfDebug(const char *format, va_list ap) {
   va_list ap1;
@@ -128,7 +199,43 @@ void Pinout::restartSunm() {
 }
 
 bool Pinout::debugWrite(const char *data, size_t len) {
-  return usb3sun_debug_write(data, len);
+  // more than the ring can ever hold, so keep what fits, and say so.
+  static const char truncated[] = " [truncated]\n";
+  const char *suffix = "";
+  size_t suffixLen = 0;
+  if (len > DebugRing::size) {
+    suffix = truncated;
+    suffixLen = sizeof truncated - 1;
+    len = DebugRing::size - suffixLen;
+  }
+  size_t core = usb3sun_core_id();
+  DebugRing &ring = debugRings[core];
+  if (ring.push(data, len, suffix, suffixLen))
+    return true;
+  // core 0 is allowed to wait for the debug uart, so rather than dropping its
+  // output, make room by draining synchronously.
+  if (core == 0) {
+    debugFlush();
+    if (ring.push(data, len, suffix, suffixLen))
+      return true;
+  }
+  ring.drop();
+  return false;
+}
+
+void Pinout::debugFlush() {
+  // core 0 only, since each ring can only have one consumer.
+  for (auto &ring : debugRings)
+    ring.drain(usb3sun_debug_write);
+}
+
+void Pinout::debugFlushForPanic() {
+  size_t core = usb3sun_core_id();
+  if (core == 0)
+    return debugFlush();
+  // core 0 may be in the middle of draining our ring, so wait for it to
+  // finish, then write the rest ourselves. the cdc belongs to core 0.
+  debugRings[core].drain(usb3sun_debug_uart_write, true);
 }
 
 bool Pinout::debugPrint(const char *text) {
@@ -151,6 +258,16 @@ bool Pinout::debugPrintf(const char *format, ...) {
   return result;
 }
 
+#if defined(DEBUG_BINARY)
+bool Pinout::debugLogText(const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  int result = vprintfDebug(format, ap);
+  va_end(ap);
+  return result;
+}
+#endif
+
 void Pinout::allowDebugOverCdc() {
   usb3sun_allow_debug_over_cdc();
 }
@@ -5,6 +5,82 @@
 
 #include "hal.h"
 
+#include <cstring>
+#include <type_traits>
+
+#if defined(DEBUG_BINARY)
+// format strings are identified by their offset from this string, which lets
+// the decoder find them in the elf even if the program was relocated.
+extern const char debugFormatAnchor[];
+#endif
+
+// binary log record: FEh, length of the rest, zigzag varint format string
+// offset, then one tagged value per argument:
+// • 'i' varint (integers up to 32 bits)
+// • 'l' varint (integers up to 64 bits)
+// • 'p' varint (pointers)
+// • 'd' 8 bytes (floating point, as ieee 754 double)
+// • 's' length byte and bytes (strings up to maxString)
+// bytes outside of records are plain text (FEh never appears in utf-8).
+// anything that doesn’t fit (a longer string, or more than 255 bytes in all)
+// is logged as text instead, so nothing is ever cut short.
+struct DebugRecord {
+  static const uint8_t sync = 0xFE;
+  static const size_t maxString = 64;
+  uint8_t data[2 + 255];
+  size_t len = 2;
+  bool overflow = false;
+
+  void byte(uint8_t value) {
+    if (len < sizeof data)
+      data[len++] = value;
+    else
+      overflow = true;
+  }
+  void varint(uint64_t value) {
+    do {
+      uint8_t low = value & 0x7F;
+      value >>= 7;
+      byte(value ? low | 0x80 : low);
+    } while (value);
+  }
+  void arg(const char *value) {
+    size_t n = value ? strnlen(value, maxString + 1) : 0;
+    if (n > maxString) {
+      overflow = true;
+      return;
+    }
+    byte('s');
+    byte(n);
+    for (size_t i = 0; i < n; i++)
+      byte(value[i]);
+  }
+  void arg(char *value) {
+    arg(static_cast<const char *>(value));
+  }
+  template <typename T>
+  void arg(T value) {
+    if constexpr (std::is_integral_v<T> && sizeof(T) <= 4) {
+      byte('i');
+      varint(static_cast<uint32_t>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+      byte('l');
+      varint(static_cast<uint64_t>(value));
+    } else if constexpr (std::is_pointer_v<T>) {
+      byte('p');
+      varint(reinterpret_cast<uintptr_t>(value));
+    } else {
+      static_assert(std::is_floating_point_v<T>, "unsupported argument type");
+      double d = value;
+      uint8_t bytes[sizeof d];
+      memcpy(bytes, &d, sizeof d);
+      byte('d');
+      for (auto b : bytes)
+        byte(b);
+    }
+  }
+};
+
 struct Pinout {
   Pinout();
   void begin();
@@ -15,14 +91,50 @@ struct Pinout {
   bool debugPrintln();
   bool debugPrintln(const char *text);
   bool debugPrintf(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+  // writes any buffered debug output (core 0 only).
+  void debugFlush();
+  // for panics: writes this core’s buffered output straight to the debug uart
+  // (or on core 0, everything to the debug uart and cdc as usual).
+  void debugFlushForPanic();
+#if defined(DEBUG_BINARY)
+  template <typename... Args> bool debugLog(const char *format, Args... args);
+  bool debugLogln() { return debugLog("\n"); }
+  bool debugLogln(const char *text) { return debugLog("%s\n", text); }
+  // returns false if the record overflowed, in which case it’s incomplete.
+  template <typename... Args> static bool debugEncode(DebugRecord &record, const char *format, Args... args);
+#endif
 
 private:
   void v1();
   void v2();
   void allowDebugOverCdc();
   void allowDebugOverUart();
+#if defined(DEBUG_BINARY)
+  // like debugPrintf, but without -Wformat, for formats passed through debugLog.
+  bool debugLogText(const char *format, ...);
+#endif
 };
 
 extern Pinout pinout;
 
+#if defined(DEBUG_BINARY)
+template <typename... Args>
+bool Pinout::debugEncode(DebugRecord &record, const char *format, Args... args) {
+  intptr_t offset = format - debugFormatAnchor;
+  record.data[0] = DebugRecord::sync;
+  record.varint(static_cast<uint64_t>(offset) << 1 ^ static_cast<uint64_t>(offset < 0 ? -1 : 0));
+  (record.arg(args), ...);
+  record.data[1] = record.len - 2;
+  return !record.overflow;
+}
+
+template <typename... Args>
+bool Pinout::debugLog(const char *format, Args... args) {
+  DebugRecord record{};
+  if (!debugEncode(record, format, args...))
+    return debugLogText(format, args...);
+  return debugWrite(reinterpret_cast<const char *>(record.data), record.len);
+}
+#endif
+
 #endif
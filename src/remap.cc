@@ -0,0 +1,101 @@
+#include "config.h"
+#include "remap.h"
+
+#include <atomic>
+
+#include "layout.h"
+#include "mutex.h"
+#include "pinout.h"
+#include "settings.h"
+#include "sunk.h"
+
+const UsbkToSunk *activeUsbkToSunk = &SUNK_LAYOUTS[0].usbkToSunk;
+
+// allocated on first use, so adapters without remaps don’t spend the ram.
+static UsbkToSunk *merged = nullptr;
+static std::atomic<bool> rebuildPending{false};
+
+void remapRebuild() {
+  // keys held on usb keyboards would have their breaks looked up in the new
+  // table, and sunkSend drops those as strays, so release them first.
+  for (size_t slot = 0; slot <= UHID_SLOTS; slot++)
+    sunkReleaseAll(usbKeySource(slot));
+  RemapV2::Value remap;
+  {
+    MutexGuard m{&settingsMutex};
+    remap = settings.remap;
+  }
+  const UsbkToSunk &base = sunkLayout().usbkToSunk;
+  size_t count = 0;
+  for (const auto &entry : remap.entries)
+    count += entry.usbk != 0;
+  if (count == 0) {
+    activeUsbkToSunk = &base;
+    return;
+  }
+  if (!merged)
+    merged = new UsbkToSunk{base};
+  else
+    *merged = base;
+  for (const auto &entry : remap.entries) {
+    // modifiers are looked up by their bit in the usb report, not usage id.
+    if (entry.usbk >= 0xE0 && entry.usbk <= 0xE7)
+      merged->entries[1u << (entry.usbk - 0xE0)].dv = entry.sunkMake;
+    else if (entry.usbk != 0)
+      merged->entries[entry.usbk].sel = entry.sunkMake;
+  }
+  activeUsbkToSunk = merged;
+  Sprintf("remap: merged %zu bindings\n", count);
+}
+
+void remapRebuildLater() {
+  rebuildPending = true;
+}
+
+void remapUpdate() {
+  if (rebuildPending.exchange(false))
+    remapRebuild();
+}
+
+static void save(const RemapV2::Value &remap) {
+  {
+    MutexGuard m{&settingsMutex};
+    settings.remap = remap;
+  }
+  settings.write<RemapV2>(remap);
+  remapRebuildLater();
+}
+
+bool remapBind(uint8_t usbk, uint8_t sunkMake) {
+  RemapV2::Value remap = settings.remap;
+  RemapV2::Entry *slot = nullptr;
+  for (auto &entry : remap.entries)
+    if (entry.usbk == usbk)
+      slot = &entry;
+  for (auto &entry : remap.entries)
+    if (entry.usbk == 0 && !slot)
+      slot = &entry;
+  if (!slot)
+    return false;
+  *slot = {usbk, sunkMake};
+  save(remap);
+  return true;
+}
+
+bool remapUnbind(uint8_t usbk) {
+  RemapV2::Value remap = settings.remap;
+  bool found = false;
+  for (auto &entry : remap.entries) {
+    if (entry.usbk == usbk) {
+      entry = {};
+      found = true;
+    }
+  }
+  if (found)
+    save(remap);
+  return found;
+}
+
+void remapReset() {
+  save(RemapV2::defaultValue);
+}
@@ -0,0 +1,30 @@
+#ifndef USB3SUN_REMAP_H
+#define USB3SUN_REMAP_H
+
+#include "config.h"
+
+#include <cstdint>
+
+#include "bindings.h"
+
+// the table DefaultView looks up every key in: the current layout’s table in
+// flash, or if settings.remap has any entries, a copy in ram with them merged
+// in. only core 1 reads or rebuilds it, so lookups need no lock.
+extern const UsbkToSunk *activeUsbkToSunk;
+
+// rebuilds it after settings.keyboardLayout or settings.remap change.
+// core 1 only (or before core 1 starts).
+void remapRebuild();
+// asks core 1 to rebuild on its next remapUpdate(), from core 0.
+void remapRebuildLater();
+// core 1, from loop1().
+void remapUpdate();
+
+// sets (or with sunkMake = 0, disables) one key in settings.remap, writing it
+// to flash. fails if there’s no room for another entry.
+bool remapBind(uint8_t usbk, uint8_t sunkMake);
+// returns the key to the layout’s binding. fails if it wasn’t remapped.
+bool remapUnbind(uint8_t usbk);
+void remapReset();
+
+#endif
@@ -0,0 +1,156 @@
+#include "config.h"
+#include "replay.h"
+
+#ifdef USB3SUN_HAL_LINUX_NATIVE
+
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "hal.h"
+#include "usb.h"
+
+// defined in main.cc.
+void setup();
+void setup1();
+void loop();
+void loop1();
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_report, uint16_t desc_len);
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len);
+void tuh_umount_cb(uint8_t dev_addr);
+
+int replayCapture(FILE *input, double speed, std::ostream &output) {
+  using Clock = std::chrono::steady_clock;
+  usb3sun_test_init(SunkWriteOp::id | SunmWriteOp::id);
+  usb3sun_test_virtual_clock(true);
+  usb3sun_test_uart_model(true);
+  usb3sun_mock_uhid_request_report_result(true);
+  setup();
+  setup1();
+  usb3sun_test_clear_history();
+
+  // the hal only mocks one if_protocol, so remember each interface’s, along
+  // with the length of its reports. boot keyboard reports are always 8 bytes,
+  // and other reports are as long as the first one we see.
+  struct Interface {
+    uint8_t if_protocol;
+    uint16_t len;
+  };
+  std::map<std::pair<unsigned, unsigned>, Interface> interfaces{};
+  std::optional<uint64_t> lastMicros{};
+  size_t reports = 0;
+  size_t rejected = 0;
+  Clock::duration busy{};
+  char line[1024];
+  for (size_t lineNumber = 1; fgets(line, sizeof line, input); lineNumber++) {
+    const char *p = strstr(line, "@hid ");
+    if (!p) continue;
+    char kind[8];
+    uint64_t micros;
+    int n;
+    if (sscanf(p, "@hid %7s %" SCNu64 "%n", kind, &micros, &n) != 2) {
+      fprintf(stderr, "warning: line %zu: bad event\n", lineNumber);
+      continue;
+    }
+    p += n;
+
+    // a capture spanning a reboot goes back in time, so treat that as no delay.
+    uint64_t delay = lastMicros && micros > *lastMicros ? micros - *lastMicros : 0;
+    lastMicros = micros;
+    if (speed > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double, std::micro>{delay / speed});
+    usb3sun_test_advance_micros(delay);
+
+    auto start = Clock::now();
+    unsigned dev_addr, instance;
+    if (!strcmp(kind, "mount")) {
+      unsigned vid, pid, if_protocol;
+      if (sscanf(p, " %u:%u %x:%x %u%n", &dev_addr, &instance, &vid, &pid, &if_protocol, &n) != 5) {
+        fprintf(stderr, "warning: line %zu: bad mount\n", lineNumber);
+        continue;
+      }
+      p += n;
+      std::vector<usb3sun_hid_report_info> infos{};
+      unsigned report_id, usage, usage_page;
+      while (sscanf(p, " %u/%x/%x%n", &report_id, &usage, &usage_page, &n) == 3) {
+        infos.push_back(usb3sun_hid_report_info {
+          static_cast<uint8_t>(report_id), static_cast<uint8_t>(usage), static_cast<uint16_t>(usage_page)});
+        p += n;
+      }
+      interfaces[{dev_addr, instance}] = Interface {
+        static_cast<uint8_t>(if_protocol),
+        static_cast<uint16_t>(if_protocol == USB3SUN_UHID_KEYBOARD ? sizeof(UsbkReport) : 0)};
+      usb3sun_mock_usb_vid_pid(true, vid, pid);
+      usb3sun_mock_uhid_parse_report_descriptor(infos);
+      usb3sun_mock_uhid_interface_protocol(if_protocol);
+      tuh_hid_mount_cb(dev_addr, instance, nullptr, 0);
+    } else if (!strcmp(kind, "report")) {
+      if (sscanf(p, " %u:%u%n", &dev_addr, &instance, &n) != 2) {
+        fprintf(stderr, "warning: line %zu: bad report\n", lineNumber);
+        continue;
+      }
+      p += n;
+      uint8_t report[64];
+      uint16_t len = 0;
+      unsigned byte;
+      while (len < sizeof report && sscanf(p, " %x%n", &byte, &n) == 1) {
+        report[len++] = byte;
+        p += n;
+      }
+      // a report that doesn’t match what was mounted is probably a line that
+      // was cut short, so rather than zero-padding it, leave it out.
+      auto interface = interfaces.find({dev_addr, instance});
+      if (interface != interfaces.end()) {
+        uint16_t &expected = interface->second.len;
+        if (expected == 0)
+          expected = len;
+        if (len != expected) {
+          fprintf(stderr, "warning: line %zu: report is %u bytes, but %u:%u sends %u\n",
+            lineNumber, len, dev_addr, instance, expected);
+          rejected++;
+          continue;
+        }
+      }
+      usb3sun_mock_uhid_interface_protocol(interface != interfaces.end() ? interface->second.if_protocol : 0);
+      tuh_hid_report_received_cb(dev_addr, instance, report, len);
+      reports++;
+    } else if (!strcmp(kind, "umount")) {
+      if (sscanf(p, " %u", &dev_addr) != 1) {
+        fprintf(stderr, "warning: line %zu: bad umount\n", lineNumber);
+        continue;
+      }
+      for (auto i = interfaces.begin(); i != interfaces.end();)
+        i = i->first.first == dev_addr ? interfaces.erase(i) : std::next(i);
+      tuh_umount_cb(dev_addr);
+    } else {
+      fprintf(stderr, "warning: line %zu: unknown event %s\n", lineNumber, kind);
+      continue;
+    }
+    loop();
+    loop1();
+    busy += Clock::now() - start;
+  }
+  if (ferror(input)) {
+    perror("fatal: failed to read capture");
+    return 1;
+  }
+
+  output << usb3sun_test_get_history() << std::flush;
+  double busyNanos = std::chrono::duration<double, std::nano>{busy}.count();
+  fprintf(stderr, "replayed %zu reports in %.3f ms of processing (%.0f ns/report)\n",
+    reports, busyNanos / 1e6, reports > 0 ? busyNanos / reports : 0);
+  if (rejected > 0)
+    fprintf(stderr, "rejected %zu reports with the wrong length\n", rejected);
+  std::cerr << "sun keyboard: " << usb3sun_test_sunk_stats() << "\n";
+  std::cerr << "sun mouse: " << usb3sun_test_sunm_stats() << "\n";
+  return 0;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef USB3SUN_REPLAY_H
+#define USB3SUN_REPLAY_H
+
+#include <cstdio>
+#include <ostream>
+
+// replays usb hid traffic captured with `log capture` through the firmware,
+// then writes the resulting sun keyboard and mouse output to output.
+//
+// captures are read from the debug uart, one event per line, ignoring any
+// other output. times are in micros, usb addresses are dev_addr:instance,
+// and bytes are in hex:
+//
+//     @hid mount <time> <dev>:<inst> <vid>:<pid> <if_protocol> [<report_id>/<usage>/<usage_page>...]
+//     @hid report <time> <dev>:<inst> [<byte>...]
+//     @hid umount <time> <dev>
+//
+// reports with the wrong length for their interface are left out, with a
+// warning, since they were probably cut short.
+//
+// the firmware sees the captured delays on its (virtual) clock. we also wait
+// in real time, divided by speed, unless speed is zero. returns a process
+// exit status.
+int replayCapture(FILE *input, double speed, std::ostream &output);
+
+#endif
@@ -3,6 +3,10 @@
 
 #include "hal.h"
 
+const char *const LOG_CATEGORY_NAMES[7] = {
+  "buzzer", "sunk", "sunm", "uhid", "timings", "progress", "capture",
+};
+
 void Settings::begin() {
   if (usb3sun_fs_init()) {
     Sprintln("settings: mounted");
@@ -41,4 +45,7 @@ void Settings::readAll() {
       write<HostidV2>(hostid);
     }
   }
+  read<KeyboardLayoutV2>(keyboardLayout);
+  read<RemapV2>(remap);
+  read<LogCategoriesV2>(logCategories);
 }
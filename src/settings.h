@@ -9,6 +9,7 @@
 #include "hal.h"
 #include "mutex.h"
 #include "pinout.h"
+#include "trace.h"
 
 #define SETTING_V1_WRAPPER_TYPE(_wrapper_name, _file_name, _padding_before, _payload_type, _padding_after, ...) \
   struct __attribute__((packed)) _wrapper_name { \
@@ -54,6 +55,7 @@ extern usb3sun_mutex settingsMutex;
 
 SETTING_ENUM(ForceClick, NO, OFF, ON);
 SETTING_ENUM(MouseBaud, S1200, S2400, S4800, S9600);
+SETTING_ENUM(KeyboardLayout, US, UK, DE);
 struct ClickDurationV2 {
   static constexpr const char *const path = "/clickDuration.v2";
   using Value = uint64_t;
@@ -69,6 +71,11 @@ struct MouseBaudV2 {
   using Value = MouseBaud;
   static constexpr Value defaultValue {MouseBaud::_::S9600};
 };
+struct KeyboardLayoutV2 {
+  static constexpr const char *const path = "/keyboardLayout.v2";
+  using Value = KeyboardLayout;
+  static constexpr Value defaultValue {KeyboardLayout::_::US};
+};
 struct HostidV2 {
   static constexpr const char *const path = "/hostid.v2";
   // wrapper type to ensure that hostid values are modifiable lvalues.
@@ -88,6 +95,42 @@ struct HostidV2 {
   };
   static constexpr Value defaultValue {{'0', '0', '0', '0', '0', '0'}};
 };
+// user overrides for the current layout’s bindings (see remap.h), set with
+// the cli. merged into the lookup table when they change, not on every key.
+struct RemapV2 {
+  static constexpr const char *const path = "/remap.v2";
+  static constexpr size_t capacity = 16;
+  struct Entry {
+    uint8_t usbk; // usage id: selector, E0h–E7h for modifiers, or 0 if unused
+    uint8_t sunkMake; // or 0 to make the key do nothing
+  };
+  struct Value {
+    Entry entries[capacity];
+    inline bool operator==(const Value &other) const {
+      return !memcmp(entries, other.entries, sizeof entries);
+    }
+    inline bool operator!=(const Value &other) const {
+      return !(*this == other);
+    }
+  };
+  static constexpr Value defaultValue {};
+};
+// runtime debug logging categories, all off by default.
+enum LogCategory: uint32_t {
+  LOG_BUZZER = 1u << 0,   // buzzer state changes
+  LOG_SUNK = 1u << 1,     // sun keyboard tx
+  LOG_SUNM = 1u << 2,     // sun mouse tx
+  LOG_UHID = 1u << 3,     // usb hid reports
+  LOG_TIMINGS = 1u << 4,  // time spent on critical operations
+  LOG_PROGRESS = 1u << 5, // one character per hid report or led update
+  LOG_CAPTURE = 1u << 6,  // usb hid mounts and reports, for `program replay`
+};
+extern const char *const LOG_CATEGORY_NAMES[7];
+struct LogCategoriesV2 {
+  static constexpr const char *const path = "/logCategories.v2";
+  using Value = uint32_t;
+  static constexpr Value defaultValue {0};
+};
 SETTING_V1_WRAPPER_TYPE(ClickDurationV1, "clickDuration", 4, ClickDurationV2::Value, 0, ClickDurationV2::defaultValue);
 SETTING_V1_WRAPPER_TYPE(ForceClickV1, "forceClick", 0, ForceClickV2::Value, 0, ForceClickV2::defaultValue);
 SETTING_V1_WRAPPER_TYPE(MouseBaudV1, "mouseBaud", 0, MouseBaudV2::Value, 0, MouseBaudV2::defaultValue);
@@ -95,7 +138,10 @@ SETTING_V1_WRAPPER_TYPE(HostidV1, "hostid", 0, HostidV2::Value, 2, HostidV2::def
 static_assert(sizeof (ClickDurationV2::Value) == 8);
 static_assert(sizeof (ForceClickV2::Value) == 4);
 static_assert(sizeof (MouseBaudV2::Value) == 4);
+static_assert(sizeof (KeyboardLayoutV2::Value) == 4);
 static_assert(sizeof (HostidV2::Value) == 6);
+static_assert(sizeof (RemapV2::Value) == 32);
+static_assert(sizeof (LogCategoriesV2::Value) == 4);
 static_assert(sizeof (ClickDurationV1) == 16);
 static_assert(sizeof (ForceClickV1) == 8);
 static_assert(sizeof (MouseBaudV1) == 8);
@@ -105,12 +151,17 @@ struct Settings {
   ForceClickV2::Value forceClick {ForceClickV2::defaultValue};
   MouseBaudV2::Value mouseBaud {MouseBaudV2::defaultValue};
   HostidV2::Value hostid {HostidV2::defaultValue};
+  KeyboardLayoutV2::Value keyboardLayout {KeyboardLayoutV2::defaultValue};
+  // not in the settings menu, so not compared below (see the cli instead).
+  RemapV2::Value remap {RemapV2::defaultValue};
+  LogCategoriesV2::Value logCategories {LogCategoriesV2::defaultValue};
 
   inline bool operator==(const Settings &other) const {
     return this->clickDuration == other.clickDuration
       && this->forceClick == other.forceClick
       && this->mouseBaud == other.mouseBaud
-      && this->hostid == other.hostid;
+      && this->hostid == other.hostid
+      && this->keyboardLayout == other.keyboardLayout;
   }
   inline bool operator!=(const Settings& other) const {
     return !(*this == other);
@@ -131,6 +182,11 @@ struct Settings {
     }
   }
 
+  // checked before formatting any verbose logging, so keep it cheap.
+  bool logging(uint32_t categories) const {
+    return __builtin_expect(!!(logCategories & categories), 0);
+  }
+
   static void begin();
   void readAll();
   template <typename SettingV1> bool readV1(SettingV1& setting);
@@ -175,6 +231,7 @@ bool Settings::read(Value& value) {
 template <typename Setting, typename Value>
 void Settings::write(const Value& value) {
   MutexGuard m{&settingsMutex};
+  trace(TraceEvent::SETTINGS_WRITE, Setting::path, strlen(Setting::path));
   if (usb3sun_fs_write(Setting::path, reinterpret_cast<const char *>(&value), sizeof value)) {
     Sprintf("settings: write %s: ok\n", Setting::path);
   } else {
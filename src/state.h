@@ -10,8 +10,7 @@ struct State {
   bool compose = false;
   bool scroll = false;
   bool num = false;
-  uint8_t lastModifiers;
-  uint8_t lastKeys[6];
+  uint8_t lastModifiers; // held on any usb keyboard
   uint8_t lastButtons;
 };
 
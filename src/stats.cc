@@ -0,0 +1,64 @@
+#include "config.h"
+#include "stats.h"
+
+#include <cstring>
+
+#include "hal.h"
+#include "pinout.h"
+
+namespace {
+
+constexpr size_t statCount = static_cast<size_t>(Stat::VALUE_COUNT);
+
+}
+
+// one set per core, so that counting needs no locking.
+static uint32_t counts[2][statCount]{};
+static uint64_t since = 0;
+
+static const char *const STAT_NAMES[statCount] = {
+  "uhid keyboard reports",
+  "uhid mouse reports",
+  "sunk tx bytes",
+  "sunk rx bytes",
+  "sunk dropped keys",
+  "sunm tx packets",
+  "capture dropped lines",
+};
+
+void statsCount(Stat stat, uint32_t count) {
+  counts[usb3sun_core_id()][static_cast<size_t>(stat)] += count;
+}
+
+uint32_t statsGet(Stat stat) {
+  uint32_t result = 0;
+  for (const auto &core : counts)
+    result += core[static_cast<size_t>(stat)];
+  return result;
+}
+
+const char *statName(Stat stat) {
+  auto i = static_cast<size_t>(stat);
+  return i < statCount ? STAT_NAMES[i] : "?";
+}
+
+void statsDump() {
+  uint64_t now = usb3sun_micros();
+  uint64_t elapsed = now - since;
+  Sprintf("stats: uptime %llu s, counting for %llu s\n",
+    static_cast<unsigned long long>(now / 1'000'000),
+    static_cast<unsigned long long>(elapsed / 1'000'000));
+  for (size_t i = 0; i < statCount; i++) {
+    uint32_t count = statsGet(static_cast<Stat>(i));
+    // per second, to one decimal place.
+    uint64_t rate = elapsed > 0 ? count * 10'000'000ull / elapsed : 0;
+    Sprintf("stats: %-22s %10lu (%llu.%llu/s)\n", STAT_NAMES[i],
+      static_cast<unsigned long>(count),
+      static_cast<unsigned long long>(rate / 10), static_cast<unsigned long long>(rate % 10));
+  }
+}
+
+void statsReset() {
+  memset(counts, 0, sizeof counts);
+  since = usb3sun_micros();
+}
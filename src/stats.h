@@ -0,0 +1,28 @@
+#ifndef USB3SUN_STATS_H
+#define USB3SUN_STATS_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// event counts since boot (or since `stats reset` in the debug cli), so a
+// live adapter can be checked without turning on verbose logging.
+enum class Stat : uint8_t {
+  UHID_KEYBOARD_REPORT,
+  UHID_MOUSE_REPORT,
+  SUNK_TX,
+  SUNK_RX,
+  SUNK_DROPPED, // repeated makes or stray breaks (see sunkSend)
+  SUNM_TX,
+  CAPTURE_DROPPED, // `log capture` lines lost to a full debug buffer
+  VALUE_COUNT,
+};
+
+void statsCount(Stat stat, uint32_t count = 1);
+uint32_t statsGet(Stat stat);
+const char *statName(Stat stat);
+void statsDump();
+void statsReset();
+
+#endif
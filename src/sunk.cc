@@ -1,39 +1,54 @@
 #include "sunk.h"
 
+#include <atomic>
+#include <bitset>
 #include <cstdint>
+#include <iterator>
 
 #include "bindings.h"
 #include "buzzer.h"
 #include "hal.h"
+#include "latency.h"
+#include "mutex.h"
 #include "pinout.h"
+#include "settings.h"
+#include "stats.h"
+#include "trace.h"
 
-void sunkSend(bool make, uint8_t code) {
-  static int activeCount = 0;
-  if (make) {
-    activeCount += 1;
-    buzzer.click();
-  } else {
-    activeCount -= 1;
-    code |= SUNK_BREAK_BIT;
-  }
+// the keys held by each source, and how many sources hold each key.
+static std::bitset<128> held[static_cast<size_t>(KeySource::COUNT)];
+static uint8_t holders[128];
+static size_t heldCount = 0;
 
-#ifdef SUNK_ENABLE
-#ifdef SUNK_VERBOSE
-  Sprintf("sunk: tx %02Xh\n", code);
-#endif
-  usb3sun_sunk_write(&code, sizeof code);
-#endif
+// bytes for the sun keyboard, in the order sunkSend decided on them, so we
+// can write them without holding sunkMutex across the (blocking) uart write.
+// each byte keeps the latency stamp of the input that caused it, since
+// either core may be the one to write it.
+struct TxEntry {
+  uint8_t code;
+  LatencyStamp latency;
+};
+static TxEntry txQueue[32];
+static size_t txHead = 0;
+static size_t txLen = 0;
+// set while one core is writing out the queue.
+static std::atomic<bool> txBusy{false};
 
-  if (activeCount <= 0) {
-    activeCount = 0;
+static void sunkWrite(uint8_t code, const LatencyStamp &latency) {
 #ifdef SUNK_ENABLE
-#ifdef SUNK_VERBOSE
-    Sprintf("sunk: idle\n");
-#endif
-    uint8_t code = SUNK_IDLE;
-    usb3sun_sunk_write(&code, sizeof code);
-#endif
+  if (settings.logging(LOG_SUNK)) {
+    if (code == SUNK_IDLE)
+      Sprintf("sunk: idle\n");
+    else
+      Sprintf("sunk: tx %02Xh\n", code);
   }
+  trace(TraceEvent::SUNK_TX, &code, sizeof code);
+  statsCount(Stat::SUNK_TX);
+  usb3sun_sunk_write(&code, sizeof code);
+  latencyEnd(latency);
+#else
+  (void) latency;
+#endif
 
   switch (code) {
     case SUNK_POWER:
@@ -46,3 +61,86 @@ void sunkSend(bool make, uint8_t code) {
       break;
   }
 }
+
+// writes out the queue, unless the other core is already doing that, in
+// which case it writes out our bytes too.
+static void sunkFlush() {
+  while (!txBusy.exchange(true, std::memory_order_acquire)) {
+    while (true) {
+      TxEntry entry;
+      {
+        MutexGuard m{&sunkMutex};
+        if (txLen == 0)
+          break;
+        entry = txQueue[txHead];
+        txHead = (txHead + 1) % std::size(txQueue);
+        txLen -= 1;
+      }
+      sunkWrite(entry.code, entry.latency);
+    }
+    txBusy.store(false, std::memory_order_release);
+    // the other core may have queued more after we emptied the queue, but
+    // before it could see that we were done.
+    MutexGuard m{&sunkMutex};
+    if (txLen == 0)
+      return;
+  }
+}
+
+static void txPush(uint8_t code) {
+  txQueue[(txHead + txLen++) % std::size(txQueue)] = {code, latencyStamp()};
+}
+
+// the held-key bookkeeping for sunkSend, queueing any bytes to write. returns
+// false if there’s no room in the queue.
+static bool sunkQueue(KeySource source, bool make, uint8_t code, bool &click) {
+  MutexGuard m{&sunkMutex};
+  // room for the key and an idle.
+  if (txLen + 2 > std::size(txQueue))
+    return false;
+  auto &sourceHeld = held[static_cast<size_t>(source)];
+  if (sourceHeld[code] == make) {
+    statsCount(Stat::SUNK_DROPPED);
+    if (settings.logging(LOG_SUNK))
+      Sprintf("sunk: dropped %s %02Xh from source %u\n", make ? "make" : "break", code, static_cast<unsigned>(source));
+    return true;
+  }
+  sourceHeld[code] = make;
+  if (make) {
+    if (holders[code]++ > 0)
+      return true;
+    heldCount += 1;
+    click = true;
+  } else {
+    if (--holders[code] > 0)
+      return true;
+    heldCount -= 1;
+    code |= SUNK_BREAK_BIT;
+  }
+  txPush(code);
+  if (heldCount == 0)
+    txPush(SUNK_IDLE);
+  return true;
+}
+
+void sunkSend(KeySource source, bool make, uint8_t code) {
+  code &= ~SUNK_BREAK_BIT;
+  bool click = false;
+  // the queue only fills up while the other core is writing, so wait for it.
+  while (!sunkQueue(source, make, code, click))
+    sunkFlush();
+  if (click)
+    buzzer.click();
+  sunkFlush();
+}
+
+void sunkReleaseAll(KeySource source) {
+  std::bitset<128> codes;
+  {
+    MutexGuard m{&sunkMutex};
+    codes = held[static_cast<size_t>(source)];
+  }
+  for (uint8_t code = 0; code < codes.size(); code++)
+    if (codes[code])
+      sunkSend(source, false, code);
+}
@@ -7,33 +7,61 @@
 #include <cstdio>
 
 #include "bindings.h"
+#include "layout.h"
+#include "macro.h"
 #include "pinout.h"
+#include "view.h"
 
-// internal flags (not part of real keycode)
-#define SUNK_SEND_SHIFT 0x100
-#define SHIFT(code) (SUNK_SEND_SHIFT | (code))
+// makes or breaks a key for one source. the sun keyboard sees a make when
+// the first source presses the key, and a break when the last one releases
+// it, and repeated makes or stray breaks from one source are dropped.
+void sunkSend(KeySource source, bool make, uint8_t code);
+// releases every key the source holds, as if it had broken them all.
+void sunkReleaseAll(KeySource source);
 
-const uint16_t ASCII_TO_SUNK[128] = {
-    /* 00h */ 0, 0, 0, 0, 0, 0, 0, 0,
-    /* 08h */ 0, 0, SUNK_RETURN, 0, 0, 0, 0, 0,
-    /* 10h */ 0, 0, 0, 0, 0, 0, 0, 0,
-    /* 18h */ 0, 0, 0, 0, 0, 0, 0, 0,
-    /* 20h */ 0x79, SHIFT(0x1E), SHIFT(0x57), SHIFT(0x20), SHIFT(0x21), SHIFT(0x22), SHIFT(0x24), 0x57,
-    /* 28h */ SHIFT(0x26), SHIFT(0x27), SHIFT(0x25), SHIFT(0x29), 0x6B, 0x28, 0x6C, 0x6D,
-    /* 30h */ 0x27, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,
-    /* 38h */ 0x25, 0x26, SHIFT(0x56), 0x56, SHIFT(0x6B), 0x2A, SHIFT(0x6C), SHIFT(0x6D),
-    /* 40h */ SHIFT(0x1F), SHIFT(0x4D), SHIFT(0x68), SHIFT(0x66), SHIFT(0x4F), SHIFT(0x38), SHIFT(0x50), SHIFT(0x51),
-    /* 48h */ SHIFT(0x52), SHIFT(0x3D), SHIFT(0x53), SHIFT(0x54), SHIFT(0x55), SHIFT(0x6A), SHIFT(0x69), SHIFT(0x3E),
-    /* 50h */ SHIFT(0x3F), SHIFT(0x36), SHIFT(0x39), SHIFT(0x4E), SHIFT(0x3A), SHIFT(0x3C), SHIFT(0x67), SHIFT(0x37),
-    /* 58h */ SHIFT(0x65), SHIFT(0x3B), SHIFT(0x64), 0x40, 0x58, 0x41, SHIFT(0x23), SHIFT(0x28),
-    /* 60h */ 0x2A, 0x4D, 0x68, 0x66, 0x4F, 0x38, 0x50, 0x51,
-    /* 68h */ 0x52, 0x3D, 0x53, 0x54, 0x55, 0x6A, 0x69, 0x3E,
-    /* 70h */ 0x3F, 0x36, 0x39, 0x4E, 0x3A, 0x3C, 0x67, 0x37,
-    /* 78h */ 0x65, 0x3B, 0x64, SHIFT(0x40), SHIFT(0x58), SHIFT(0x41), SHIFT(0x2A), SUNK_BACKSPACE,
+extern usb3sun_mutex sunkMutex;
+
+// never defined, so that a character in a SUNK_MACRO that some layout
+// can’t type fails the build, with this name in the error.
+uint16_t sunkMacroCharacterNotInAsciiToSunk(char);
+
+// a macro already translated for each of the SUNK_LAYOUTS.
+template <size_t N>
+struct SunkMacro {
+  const char *text;
+  uint16_t keys[sizeof SUNK_LAYOUTS / sizeof *SUNK_LAYOUTS][N];
 };
 
-void sunkSend(bool make, uint8_t code);
+template <size_t N>
+constexpr SunkMacro<N - 1> sunkMacro(const char (&text)[N]) {
+  SunkMacro<N - 1> result{text, {}};
+  for (size_t layout = 0; layout < sizeof SUNK_LAYOUTS / sizeof *SUNK_LAYOUTS; layout++) {
+    const auto &asciiToSunk = SUNK_LAYOUTS[layout].asciiToSunk;
+    for (size_t i = 0; i < N - 1; i++) {
+      auto octet = static_cast<uint8_t>(text[i]);
+      result.keys[layout][i] = octet < sizeof asciiToSunk / sizeof *asciiToSunk && asciiToSunk[octet] != 0
+        ? asciiToSunk[octet]
+        : sunkMacroCharacterNotInAsciiToSunk(text[i]);
+    }
+  }
+  return result;
+}
+
+// translates a string literal at compile time, so constant macros need no
+// parsing and can’t fail at runtime.
+#define SUNK_MACRO(text) ([]() -> const auto & { \
+  static constexpr auto result = sunkMacro(text); \
+  return result; \
+}())
 
+// queues a macro to be typed on the sun keyboard (see macro.h).
+template <size_t N>
+void sunkSend(const SunkMacro<N> &keys) {
+  macro.type(keys.keys[&sunkLayout() - SUNK_LAYOUTS], N, keys.text);
+}
+
+// queues a macro to be typed on the sun keyboard, formatting and
+// translating it at runtime.
 template <typename... Args>
 void sunkSend(const char *fmt, Args... args) {
   char result[256];
@@ -42,25 +70,7 @@ void sunkSend(const char *fmt, Args... args) {
     Sprintf("sunk: macro buffer overflow");
     return;
   }
-  for (size_t i = 0; i < len; i++) {
-    auto octet = static_cast<uint8_t>(result[i]);
-    if (octet >= sizeof(ASCII_TO_SUNK) / sizeof(*ASCII_TO_SUNK) || ASCII_TO_SUNK[octet] == 0) {
-      Sprintf("sunk: octet %02Xh not in ASCII_TO_SUNK\n", octet);
-      return;
-    }
-  }
-  Sprintf("sunk: sending macro <");
-  Sprintf(fmt, args...);
-  Sprintf(">\n");
-  for (size_t i = 0; i < len; i++) {
-    auto octet = static_cast<uint8_t>(result[i]);
-    if (!!(ASCII_TO_SUNK[octet] & SUNK_SEND_SHIFT))
-      sunkSend(true, SUNK_SHIFT_L);
-    sunkSend(true, ASCII_TO_SUNK[octet] & 0xFF);
-    sunkSend(false, ASCII_TO_SUNK[octet] & 0xFF);
-    if (!!(ASCII_TO_SUNK[octet] & SUNK_SEND_SHIFT))
-      sunkSend(false, SUNK_SHIFT_L);
-  }
+  macro.type(result, len);
 }
 
 #endif
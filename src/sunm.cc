@@ -1,6 +1,10 @@
 #include "sunm.h"
 #include "bindings.h"
+#include "latency.h"
 #include "pinout.h"
+#include "settings.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <cstddef>
 
@@ -19,13 +23,14 @@ void sunmSend(int8_t x, int8_t y, bool left, bool middle, bool right) {
     (uint8_t) x, (uint8_t) -y, 0, 0,
   };
 #ifdef SUNM_ENABLE
+  trace(TraceEvent::SUNM_TX, result, sizeof result);
+  statsCount(Stat::SUNM_TX);
   size_t len = usb3sun_sunm_write(result, sizeof(result) / sizeof(*result));
-#ifdef SUNM_VERBOSE
-  Sprintf("sunm: tx %02Xh %02Xh %02Xh %02Xh %02Xh = %zu\n",
-    result[0], result[1], result[2], result[3], result[4], len);
-#else
+  latencyEnd();
+  if (settings.logging(LOG_SUNM))
+    Sprintf("sunm: tx %02Xh %02Xh %02Xh %02Xh %02Xh = %zu\n",
+      result[0], result[1], result[2], result[3], result[4], len);
   (void) len;
-#endif
 #else
   Sprintf("sunm: tx %02Xh %02Xh %02Xh %02Xh %02Xh (disabled)\n",
     result[0], result[1], result[2], result[3], result[4]);
@@ -0,0 +1,132 @@
+#include "config.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "hal.h"
+#include "pinout.h"
+
+namespace {
+
+constexpr uint32_t traceMagic = 0x75337472;
+constexpr size_t traceLen = 128;
+
+struct TraceRing {
+  // total entries ever written, so the next index is next % traceLen.
+  uint32_t next;
+  TraceEntry entries[traceLen];
+
+  size_t size() const {
+    return std::min(static_cast<size_t>(next), traceLen);
+  }
+  // i = 0 is the oldest entry still in the ring.
+  const TraceEntry &operator[](size_t i) const {
+    return entries[(next - size() + i) % traceLen];
+  }
+};
+
+struct TraceState {
+  uint32_t magic;
+  uint8_t boot;
+  TraceRing rings[2];
+};
+
+}
+
+// not zeroed on boot, so we can see what happened before a watchdog reboot.
+static TraceState traceState USB3SUN_NOINIT;
+
+const char *traceEventName(TraceEvent event) {
+  switch (event) {
+    case TraceEvent::BOOT: return "boot";
+    case TraceEvent::HID_REPORT: return "hid report";
+    case TraceEvent::SUNK_TX: return "sunk tx";
+    case TraceEvent::SUNK_RX: return "sunk rx";
+    case TraceEvent::SUNM_TX: return "sunm tx";
+    case TraceEvent::VIEW_PUSH: return "view push";
+    case TraceEvent::VIEW_POP: return "view pop";
+    case TraceEvent::SETTINGS_WRITE: return "settings write";
+  }
+  return "?";
+}
+
+void traceBegin() {
+  if (traceState.magic == traceMagic) {
+    traceState.boot++;
+  } else {
+    traceClear();
+  }
+  trace(TraceEvent::BOOT);
+}
+
+void trace(TraceEvent event, const void *data, size_t len) {
+  TraceRing &ring = traceState.rings[usb3sun_core_id()];
+  TraceEntry &entry = ring.entries[ring.next % traceLen];
+  entry.micros = usb3sun_micros();
+  entry.event = event;
+  entry.boot = traceState.boot;
+  entry.len = std::min(len, static_cast<size_t>(UINT8_MAX));
+  if (data)
+    memcpy(entry.data, data, std::min(len, sizeof entry.data));
+  ring.next++;
+}
+
+void trace(TraceEvent event, uint8_t a, uint8_t b, const void *data, size_t len) {
+  uint8_t prefixed[sizeof(TraceEntry::data)]{a, b};
+  memcpy(&prefixed[2], data, std::min(len, sizeof prefixed - 2));
+  trace(event, prefixed, len + 2);
+}
+
+void traceDump() {
+  const TraceRing &ring0 = traceState.rings[0];
+  const TraceRing &ring1 = traceState.rings[1];
+  Sprintf("trace: %zu entries on core 0, %zu entries on core 1\n", ring0.size(), ring1.size());
+  // each ring is already in order, so merge them by (boot, micros).
+  for (size_t i = 0, j = 0; i < ring0.size() || j < ring1.size();) {
+    bool takeRing0 = j >= ring1.size() || (i < ring0.size()
+      && (ring0[i].boot < ring1[j].boot
+        || (ring0[i].boot == ring1[j].boot && ring0[i].micros <= ring1[j].micros)));
+    const TraceEntry &entry = takeRing0 ? ring0[i++] : ring1[j++];
+    Sprintf("trace: boot %u core %d %10lu us: %s",
+      entry.boot, takeRing0 ? 0 : 1, static_cast<unsigned long>(entry.micros), traceEventName(entry.event));
+    size_t len = std::min(static_cast<size_t>(entry.len), sizeof entry.data);
+    switch (entry.event) {
+      case TraceEvent::VIEW_PUSH:
+      case TraceEvent::VIEW_POP:
+      case TraceEvent::SETTINGS_WRITE:
+        Sprintf(" %.*s", static_cast<int>(len), reinterpret_cast<const char *>(entry.data));
+        break;
+      case TraceEvent::HID_REPORT:
+        Sprintf(" usb [%u:%u]", entry.data[0], entry.data[1]);
+        for (size_t k = 2; k < len; k++)
+          Sprintf(" %02Xh", entry.data[k]);
+        break;
+      default:
+        for (size_t k = 0; k < len; k++)
+          Sprintf(" %02Xh", entry.data[k]);
+    }
+    Sprintln(entry.len > sizeof entry.data ? " ..." : "");
+    // the trace is bigger than our debug output buffers.
+    pinout.debugFlush();
+  }
+}
+
+size_t traceRead(size_t core, uint32_t &cursor, TraceEntry *result, size_t len) {
+  const TraceRing &ring = traceState.rings[core];
+  uint32_t next = ring.next;
+  uint32_t oldest = next - std::min(static_cast<size_t>(next), traceLen);
+  // a cursor past the end (say, after a clear) starts again from the oldest.
+  if (cursor < oldest || cursor > next)
+    cursor = oldest;
+  size_t count = std::min(static_cast<size_t>(next - cursor), len);
+  for (size_t i = 0; i < count; i++)
+    result[i] = ring.entries[(cursor + i) % traceLen];
+  cursor += count;
+  return count;
+}
+
+void traceClear() {
+  memset(&traceState, 0, sizeof traceState);
+  traceState.magic = traceMagic;
+}
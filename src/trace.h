@@ -0,0 +1,49 @@
+#ifndef USB3SUN_TRACE_H
+#define USB3SUN_TRACE_H
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// post-mortem trace of recent events, one ring per core, kept in ram that
+// survives a watchdog reboot (see USB3SUN_NOINIT). dump it with the `trace`
+// command in the debug cli.
+enum class TraceEvent : uint8_t {
+  BOOT,           // (no data)
+  HID_REPORT,     // dev_addr, instance, start of report
+  SUNK_TX,        // bytes
+  SUNK_RX,        // byte
+  SUNM_TX,        // bytes
+  VIEW_PUSH,      // name
+  VIEW_POP,       // name
+  SETTINGS_WRITE, // path
+};
+
+struct TraceEntry {
+  uint32_t micros;
+  TraceEvent event;
+  // counts up from 0 every time the trace survives a reboot.
+  uint8_t boot;
+  // length of the original data, which may be longer than what we kept.
+  uint8_t len;
+  uint8_t data[16];
+};
+static_assert(sizeof(TraceEntry) == 24);
+
+// keeps the current trace if it survived a reboot, otherwise starts a new one.
+void traceBegin();
+// cheap enough to call from anywhere, on either core.
+void trace(TraceEvent event, const void *data = nullptr, size_t len = 0);
+// like trace, but with two bytes in front of the data.
+void trace(TraceEvent event, uint8_t a, uint8_t b, const void *data, size_t len);
+// prints the trace in chronological order (core 0 only).
+void traceDump();
+const char *traceEventName(TraceEvent event);
+// copies up to len entries from the given core’s ring, starting at cursor (a
+// count of entries ever written on that core), or at the oldest entry still
+// in the ring if that’s later. the cursor ends up after the last entry.
+size_t traceRead(size_t core, uint32_t &cursor, TraceEntry *result, size_t len);
+void traceClear();
+
+#endif
@@ -9,6 +9,9 @@
 #define USB3SUN_UHID_KEYBOARD 1
 #define USB3SUN_UHID_MOUSE 2
 
+// lists the usb hid devices we’re using, for the debug cli (see main.cc).
+void uhidDump();
+
 struct __attribute__((packed)) UsbkReport {
   uint8_t modifier;
   uint8_t reserved;
@@ -2,8 +2,11 @@
 #include "view.h"
 
 #include <cstddef>
+#include <cstring>
 
 #include "panic.h"
+#include "state.h"
+#include "trace.h"
 
 static View *views[3]{};
 static size_t viewsLen = 0;
@@ -18,6 +21,7 @@ void View::push(View *view) {
   if (viewsLen >= sizeof(views) / sizeof(*views))
     panic2("View stack overflow");
 
+  trace(TraceEvent::VIEW_PUSH, view->name(), strlen(view->name()));
   views[viewsLen++] = view;
 }
 
@@ -25,7 +29,9 @@ void View::pop() {
   if (viewsLen == 0)
     panic2("View stack underflow");
 
-  views[--viewsLen] = nullptr;
+  View *view = views[--viewsLen];
+  trace(TraceEvent::VIEW_POP, view->name(), strlen(view->name()));
+  views[viewsLen] = nullptr;
 }
 
 void View::paint() {
@@ -43,13 +49,14 @@ void View::sendKeys(const UsbkChanges &changes) {
 }
 
 void View::sendMakeBreak(std::bitset<8> usbkModifiers, uint8_t usbkSelector) {
-  // FIXME: may not be correct if interleaved with real usbk input via sendKeys!
+  // views see the modifiers held on usb keyboards too, like a real report
+  // would include them, and sunkSend merges these keys with the usb keys.
   UsbkChanges makeChanges{
-    UsbkReport{(uint8_t)usbkModifiers.to_ulong(), {}, {usbkSelector}},
-    {}, {{usbkSelector, true}}, 0, 1};
+    UsbkReport{(uint8_t)(state.lastModifiers | usbkModifiers.to_ulong()), {}, {usbkSelector}},
+    {}, {{usbkSelector, true}}, 0, 1, KeySource::INJECTED};
   UsbkChanges breakChanges{
-    UsbkReport{0, {}, {}},
-    {}, {{usbkSelector, false}}, 0, 1};
+    UsbkReport{state.lastModifiers, {}, {}},
+    {}, {{usbkSelector, false}}, 0, 1, KeySource::INJECTED};
   for (size_t i = 0; i < 8; i++) {
     if (usbkModifiers[i]) {
       makeChanges.dv[makeChanges.dvLen++] = DvChange{(uint8_t)((uint8_t)1 << i), true};
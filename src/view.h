@@ -8,6 +8,28 @@
 
 #include "usb.h"
 
+// how many usb hid interfaces we keep track of (see hid[] in main.cc).
+constexpr uint8_t UHID_SLOTS = 16;
+
+// where key input came from. the sun keyboard sees the union of the keys held
+// by each source (see sunkSend), so injected input never breaks a key that a
+// usb keyboard still holds, or vice versa. each usb keyboard is its own
+// source, so two keyboards holding the same key both have to release it.
+enum class KeySource : uint8_t {
+  USB, // the usb keyboard in hid[0], and replayed captures of it
+  USB_UNLISTED = USB + UHID_SLOTS, // usb keyboards without a slot in hid[]
+  INJECTED, // View::sendMakeBreak (demo, tests)
+  MACRO, // see macro.h
+  COUNT,
+};
+
+// the source for the usb keyboard in hid[slot], or USB_UNLISTED.
+inline KeySource usbKeySource(size_t slot) {
+  if (slot >= UHID_SLOTS)
+    return KeySource::USB_UNLISTED;
+  return static_cast<KeySource>(static_cast<size_t>(KeySource::USB) + slot);
+}
+
 struct DvChange {
   uint8_t usbkModifier;
   bool make;
@@ -24,6 +46,7 @@ struct UsbkChanges {
   SelChange sel[6 * 2]{};
   size_t dvLen = 0;
   size_t selLen = 0;
+  KeySource source = KeySource::USB;
 };
 
 struct View {